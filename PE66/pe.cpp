@@ -716,7 +716,7 @@ static bool ModalPickVar(const vector<char>& vars, char& outVar) {
 
     for (int i = 0; i < (int)vars.size(); ++i) {
         Button b;
-        b.text = string(1, vars[i]);
+        b.text = varNameFromCode(vars[i]);
         int r = i / cols, c = i % cols;
         b.rc = { startX + c * (bw + gap), startY + r * (bh + gap), bw, bh };
         bs.push_back(b);
@@ -856,7 +856,7 @@ static bool ModalComposeBest(
     auto slotPreview = [&](int idx)->string {
         if (idx < 0 || idx >= n) return "<无>";
         if (!hasSlot[idx] || !slots[idx].root) return "<空>";
-        string s = slots[idx].toInfix();
+        string s = slots[idx].infixCache.substr(0, 41);
         if ((int)s.size() > 40) s = s.substr(0, 40) + "...";  // 缩短预览长度
         return s;
     };
@@ -1089,6 +1089,15 @@ static bool ModalComposeBest(
 
 static const int SLOT_N = 8;    // 槽位数量
 
+// 需要重绘的区域（按位组合）；主循环只在有区域变脏时重绘，且只重绘变脏的区域
+enum DirtyRegion : unsigned {
+    DIRTY_LEFT = 1,     // 左侧：输入框、功能按钮、变量面板
+    DIRTY_INFO = 2,     // 右侧标题和结果区
+    DIRTY_STATUS = 4,   // 状态栏
+    DIRTY_TREE = 8,     // 树绘图区
+    DIRTY_ALL = 15,
+};
+
 struct AppState;
 static void refreshVars(AppState& A);
 static void rebuildLayout(AppState& A);
@@ -1127,17 +1136,24 @@ struct AppState {
 
     Node* selectedNode = nullptr;
 
-    std::vector<Node*> undoRoots;
-    int undoMax = 20;
+    int undoMax = 4096;
     
+    // 快照与当前树共享节点（修改前先做路径复制，旧节点不再改动），每个快照只占几个指针
     struct UndoSnapshot {
         Node* root = nullptr;
-        std::map<char, double> varVals;
+        std::shared_ptr<NodeArena> arena;  // 快照节点所在的内存池（通常与当前树共享）
+        std::shared_ptr<const std::map<char, double>> varVals;  // 变量赋值（未改动时与上一快照共享）
+        std::shared_ptr<const std::string> postfix;  // 后缀/中缀缓存串（未改动时与上一快照共享），撤销时直接交还给当前树
+        std::shared_ptr<const std::string> infix;
     };
-    std::vector<UndoSnapshot> undoSnapshots;
+    std::vector<UndoSnapshot> undoRing;  // 环形缓冲，容量 undoMax，满时覆盖最旧的快照
+    int undoHead = 0;   // 下一个快照写入的位置
+    int undoCount = 0;  // 现有快照数
     //树视图切换
     int viewTreeIdx = -1;   // -1=显示当前表达式树；0..N-1=显示槽位树
     Layout viewLay{};       // 右侧当前显示树的布局
+    LayoutMode layoutMode = LAYOUT_CLASSIC;  // 右侧树的布局方式
+    TidyLayout tidy;        // 紧凑布局的缓存（对应右侧当前显示的树）
 
     //树缩放
     double treeZoom = 1.0;  // 缩放比例，1.0 = 100%
@@ -1150,39 +1166,69 @@ struct AppState {
     int treeDragStartY = 0;
     int treeOffsetX = 0;         // 树的偏移量
     int treeOffsetY = 0;
+
+    unsigned dirty = DIRTY_ALL;  // 待重绘的区域（DirtyRegion）
 };
 
 // ===================== 撤销功能 =====================
-// 撤销快照结构：保存树和变量赋值状态
-struct UndoSnapshot {
-    Node* root = nullptr;
-    std::map<char, double> varVals;
-};
+// 快照结构见 AppState::UndoSnapshot
 
 //状态保存到撤销栈
 static void PushUndo(AppState& A) {
     if (!A.hasCur || !A.cur.root) return;
+    if ((int)A.undoRing.size() != A.undoMax) {
+        A.undoRing.assign(A.undoMax, AppState::UndoSnapshot());
+        A.undoHead = A.undoCount = 0;
+    }
     AppState::UndoSnapshot snap;
-    snap.root = cloneTree(A.cur.root);
-    snap.varVals = A.varVals;
-    A.undoSnapshots.push_back(snap);
-    if ((int)A.undoSnapshots.size() > A.undoMax) {
-        freeTree(A.undoSnapshots.front().root);
-        A.undoSnapshots.erase(A.undoSnapshots.begin());
+    if (A.cur.root->inArena) {
+        // 直接共享当前树：随后的修改只复制根到修改处的路径（见 doWrapFunc），快照看到的节点保持不变
+        snap.root = A.cur.root;
+        snap.arena = A.cur.arena;
     }
+    else {
+        // 堆上的树无法共享（节点会被单独释放），退回深拷贝
+        snap.arena = std::make_shared<NodeArena>();
+        NodeArenaScope scope(snap.arena.get());
+        snap.root = cloneTree(A.cur.root);
+    }
+    const AppState::UndoSnapshot* last =
+        A.undoCount ? &A.undoRing[(A.undoHead + A.undoMax - 1) % A.undoMax] : nullptr;
+    if (last && *last->varVals == A.varVals) snap.varVals = last->varVals;
+    else snap.varVals = std::make_shared<const std::map<char, double>>(A.varVals);
+    // 缓存串按非 const 对象创建，撤销时若快照独占即可把串移回当前树
+    if (last && *last->postfix == A.cur.postfixRaw) snap.postfix = last->postfix;
+    else snap.postfix = std::make_shared<std::string>(A.cur.postfixRaw);
+    if (last && *last->infix == A.cur.infixCache) snap.infix = last->infix;
+    else snap.infix = std::make_shared<std::string>(A.cur.infixCache);
+
+    A.undoRing[A.undoHead] = std::move(snap);
+    A.undoHead = (A.undoHead + 1) % A.undoMax;
+    if (A.undoCount < A.undoMax) ++A.undoCount;
+}
+
+// 取出快照中的缓存串：快照独占时直接移走（O(1)），仍与更早的快照共享时复制
+static std::string takeSnapshotString(std::shared_ptr<const std::string>& s) {
+    if (s.use_count() == 1) return std::move(const_cast<std::string&>(*s));
+    return *s;
 }
 
 //回到上一个状态
 static void DoUndo(AppState& A) {
-    if (A.undoSnapshots.empty()) {
+    if (A.undoCount == 0) {
         A.status = "撤销：没有可撤销的操作";
         return;
     }
-	AppState::UndoSnapshot snap = A.undoSnapshots.back();   // 取出最后一个快照
-    A.undoSnapshots.pop_back();
-    if (A.cur.root) freeTree(A.cur.root);
+    A.undoHead = (A.undoHead + A.undoMax - 1) % A.undoMax;   // 取出最后一个快照
+    --A.undoCount;
+	AppState::UndoSnapshot snap = std::move(A.undoRing[A.undoHead]);
+    A.cur.releaseNodes();
     A.cur.root = snap.root;
-    A.varVals = snap.varVals;
+    A.cur.arena = std::move(snap.arena);  // 快照的内存池随根节点一起交给当前树
+    // 缓存串取自快照，不重新序列化；片段索引在下一次局部修改时按需重建
+    A.cur.postfixRaw = takeSnapshotString(snap.postfix);
+    A.cur.infixCache = takeSnapshotString(snap.infix);
+    A.varVals = *snap.varVals;
     A.hasCur = (A.cur.root != nullptr);
     A.selectedNode = nullptr;
     rebuildLayout(A);
@@ -1192,8 +1238,8 @@ static void DoUndo(AppState& A) {
 
 // 清空撤销栈
 static void clearUndo(AppState& A) {
-    for (auto& s : A.undoSnapshots) freeTree(s.root);
-    A.undoSnapshots.clear();
+    A.undoRing.clear();
+    A.undoHead = A.undoCount = 0;
 }
 
 
@@ -1206,47 +1252,30 @@ static Node* HitTestNode(const Layout& L, int mx, int my, double zoom, int cente
     int scaledR = (int)(R * zoom);
     if (scaledR < 8) scaledR = 8;
 
-    for (auto& kv : L.pos) {
-        Node* p = kv.first;
+    // 鼠标位置换回布局坐标，只检查网格中附近的节点（半径多留 2 像素抵消取整误差）
+    double lx = centerX + (mx - offsetX - centerX) / zoom;
+    double ly = centerY + (my - offsetY - centerY) / zoom;
+    int bestIdx = -1;
+    L.forEachNear(lx, ly, (scaledR + 2) / zoom, [&](int i) {
         // 计算缩放后的坐标 + 偏移量
-        int sx = centerX + (int)((kv.second.x - centerX) * zoom) + offsetX;
-        int sy = centerY + (int)((kv.second.y - centerY) * zoom) + offsetY;
+        int sx = centerX + (int)((L.x[i] - centerX) * zoom) + offsetX;
+        int sy = centerY + (int)((L.y[i] - centerY) * zoom) + offsetY;
 
         int dx = mx - sx, dy = my - sy;
         int d2 = dx * dx + dy * dy;
-        if (d2 <= scaledR * scaledR && d2 < bestD2) {
+        // 距离相同时取编号小的（与按编号顺序扫描的结果一致）
+        if (d2 <= scaledR * scaledR && (d2 < bestD2 || (d2 == bestD2 && i < bestIdx))) {
             bestD2 = d2;
-            best = p;
+            bestIdx = i;
+            best = L.nodes[i];
         }
-    }
+        });
     return best;
 }
-// 在树中查找某节点的父节点
-static bool FindParent(Node* root, Node* target, Node*& parent, bool& isLeft) {
-    if (!root) return false;
-    if (root->l == target) { parent = root; isLeft = true; return true; }
-    if (root->r == target) { parent = root; isLeft = false; return true; }
-    return FindParent(root->l, target, parent, isLeft) || FindParent(root->r, target, parent, isLeft);
-}
-
-// 将选中的节点包装为函数调用节点
+// 将选中的节点包装为函数调用节点（后缀/中缀缓存只重新生成修改处到根的路径）
 static bool WrapSelectedAsFunc(ExprTree& T, Node* selected, const std::string& funcName) {
     if (!T.root || !selected) return false;
-    Node* f = new Node();
-    f->kind = 'F';
-    f->ch = funcCodeFromName(funcName);
-    f->l = selected;
-    f->r = nullptr;
-    if (selected == T.root) {
-        T.root = f;
-        return true;
-    }
-    Node* parent = nullptr;
-    bool isLeft = true;
-    if (!FindParent(T.root, selected, parent, isLeft) || !parent) return false;
-    if (isLeft) parent->l = f;
-    else parent->r = f;
-    return true;
+    return T.wrapSubtree(selected, funcCodeFromName(funcName));
 }
 
 // ===================== 界面绘制辅助 =====================
@@ -1261,7 +1290,7 @@ static void refreshVars(AppState& A) {
 
 // 重建布局
 static void rebuildLayout(AppState& A) {
-    if (!A.hasCur) { A.lay.pos.clear(); return; }
+    if (!A.hasCur) { A.lay.clear(); return; }
     int rx = A.leftW;
     int rw = A.W - A.leftW;
 
@@ -1280,6 +1309,7 @@ static void rebuildLayout(AppState& A) {
     int maxTreeHeight = treeH - 100;
 
     A.lay = layoutTree(A.cur.root, x0, y0, xGap, yGap, maxTreeWidth, maxTreeHeight);
+    A.lay.buildGrid();
 }
 
 // ===================== 变量面板绘制 =====================
@@ -1306,8 +1336,7 @@ static void drawVarPanel(const AppState& A) {
             solidrectangle(r.x + 8, yy - 2, r.x + r.w - 8, yy + lineH - 2);
         }
         char v = A.varList[i];
-        string row;
-        row.push_back(v);
+        string row = varNameFromCode(v);
         row += " = ";
         auto it = A.varVals.find(v);
         if (it == A.varVals.end()) row += "<未赋值>";
@@ -1349,7 +1378,7 @@ static void doBuild(AppState& A) {
 // 显示中缀表达式
 static void doShowInfix(AppState& A) {
     if (!A.hasCur) { A.status = "请先解析/建树"; return; }
-    string s = A.cur.toInfix();
+    const string& s = A.cur.infixCache;
     MessageBoxW(GetHWnd(), s2ws(s).c_str(), L"一般数学表达式（中缀+括号）", MB_OK);
     A.status = "已输出中缀表达式";
 }
@@ -1363,11 +1392,11 @@ static void doAssignVar(AppState& A) {
     }
     char v = A.varList[A.selectedVarIdx];
     double val = 0;
-    string title = string("变量 ") + v + " 赋值";
+    string title = "变量 " + varNameFromCode(v) + " 赋值";
     if (ModalInputNumber(title, "例如：3.14 或 -2", val)) {
         PushUndo(A);  // ★赋值前先保存快照
         A.varVals[v] = val;
-        A.status = string("已设置 ") + v + " = " + fmtDouble(val);
+        A.status = "已设置 " + varNameFromCode(v) + " = " + fmtDouble(val);
     }
     else {
         A.status = "取消赋值";
@@ -1398,7 +1427,10 @@ static void doSaveCurToSlot(AppState& A) {
 
     A.slots[idx].clear();
     // ★使用 substituteVars 把已赋值的变量替换为常量
-    A.slots[idx].root = substituteVars(A.cur.root, A.varVals);
+    {
+        NodeArenaScope scope(A.slots[idx].ensureArena());
+        A.slots[idx].root = substituteVars(A.cur.root, A.varVals);
+    }
     A.slots[idx].updateCaches();  // ★重新生成后缀和中缀
     A.hasSlot[idx] = true;
 
@@ -1422,7 +1454,7 @@ static void doDerivativeToSlot(AppState& A) {
         }
         A.slots[idx].clear();
         A.slots[idx].root = D.root; D.root = nullptr;
-        A.slots[idx].postfixRaw = "<derivative>";
+        A.slots[idx].updateCaches();
         A.hasSlot[idx] = true;
         A.status = "偏导结果已保存到 槽位" + std::to_string(idx + 1);
         return;
@@ -1447,13 +1479,12 @@ static void doDerivativeToSlot(AppState& A) {
     }
 
     // 在 doDerivativeToSlot 函数中，保存结果时：
-    A.slots[idx].clear();
-    A.slots[idx].root = D.root; D.root = nullptr;
+    A.slots[idx].takeFrom(D);
     A.slots[idx].updateCaches();  // 生成后缀和中缀
     A.hasSlot[idx] = true;
 
     MessageBoxW(GetHWnd(), s2ws("偏导完成并保存到 槽位" + std::to_string(idx + 1) +
-        "\n\n结果（中缀+括号）：\n" + A.slots[idx].toInfix()).c_str(),
+        "\n\n结果（中缀+括号）：\n" + A.slots[idx].infixCache).c_str(),
         L"偏导结果已保存", MB_OK);
 
     A.status = "偏导结果已保存到 槽位" + std::to_string(idx + 1);
@@ -1477,9 +1508,7 @@ static void doComposeFromSlotsBest(AppState& A) {
     ExprTree R = Compose(A.slots[i], A.slots[j], op, &err);
     if (!R.root) { A.status = "构造失败：" + err; return; }
 
-    A.cur.clear();
-    A.cur.root = R.root; R.root = nullptr;
-    A.cur.postfixRaw = R.postfixRaw;
+    A.cur.takeFrom(R);  // 连同内存池和后缀串一起接管
     A.hasCur = true;
     A.selectedNode = nullptr;  // 清空选中
 
@@ -1495,6 +1524,13 @@ static void doWrapFunc(AppState& A, const std::string& fn) {
 
     PushUndo(A);  // 关键：修改前先存一份快照
 
+    // 选中节点来自右侧显示的树：登记修改位置，紧凑布局随后只重算它到根的路径
+    A.tidy.invalidate(A.selectedNode);
+    // 撤销快照共享当前树的节点：先把根到选中节点的路径换成副本，再在副本上修改
+    vector<std::pair<const Node*, Node*>> copies;
+    if (A.cur.copyPath(A.selectedNode, &copies)) {
+        for (auto& c : copies) A.tidy.rename(c.first, c.second);
+    }
     if (!WrapSelectedAsFunc(A.cur, A.selectedNode, fn)) {
         A.status = "包裹失败：未能定位被选节点";
         return;
@@ -1518,7 +1554,7 @@ static void doClear(AppState& A) {
     A.selectedVarIdx = -1;
     A.varVals.clear();
     A.lastValue = 0;
-    A.lay.pos.clear();
+    A.lay.clear();
     A.selectedNode = nullptr;
     A.treeZoom = 1.0;       // 重置缩放
     A.treeOffsetX = 0;      // 重置偏移
@@ -1553,6 +1589,7 @@ static void buildFuncButtons(AppState& A) {
     add("撤销（Undo）");
     add("清空");
     add("F11 全屏/窗口切换");
+    add("切换树布局（经典/紧凑）");
 }
 
 // 计算按钮布局
@@ -1590,7 +1627,7 @@ static void layoutFuncButtons(AppState& A) {
 }
 
 static void toggleFullscreen(AppState& A, bool& isFull);
-static void RebuildViewLayout(AppState& A);
+static void RebuildViewLayout(AppState& A, bool incremental = false);
 
 // 滚动功能按钮区
 static void scrollFunc(AppState& A, int delta) {
@@ -1600,6 +1637,20 @@ static void scrollFunc(AppState& A, int delta) {
     layoutFuncButtons(A);
 }
 
+// 按鼠标位置更新按钮的悬停状态（只有在 funcView 范围内才显示悬停效果），有变化时返回 true
+static bool updateHover(AppState& A, int mx, int my) {
+    bool inView = hitRect(A.funcView, mx, my);
+    bool changed = false;
+    for (auto& b : A.funcBtns) {
+        bool hot = inView && b.hit(mx, my);
+        if (b.hot != hot) {
+            b.hot = hot;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
 // ===================== 树视图功能 =====================
 
 // 获取"当前显示树"的 root
@@ -1614,8 +1665,8 @@ static Node* GetViewRoot(const AppState& A) {
     return nullptr;
 }
 
-// 重建右侧树布局
-static void RebuildViewLayout(AppState& A) {
+// 重建右侧树布局；incremental 为 true 时紧凑布局只重算 invalidate 登记过的路径（用于包裹等局部修改之后）
+static void RebuildViewLayout(AppState& A, bool incremental) {
     int rx = A.leftW;
     int rw = A.W - A.leftW;
 
@@ -1637,7 +1688,18 @@ static void RebuildViewLayout(AppState& A) {
     int maxTreeWidth = rw - 60;      // 留出左右边距
     int maxTreeHeight = treeH - 100; // 留出上下边距
 
-    A.viewLay = layoutTree(root, x0, y0, xGap, yGap, maxTreeWidth, maxTreeHeight);
+    if (A.layoutMode == LAYOUT_TIDY) {
+        // 紧凑布局：同层节点中心距 44（节点直径 36 加留白），层距 60
+        const int tidyXGap = 44, tidyYGap = 60;
+        if (incremental)
+            A.viewLay = A.tidy.relayout(root, x0, y0, tidyXGap, tidyYGap, maxTreeWidth, maxTreeHeight);
+        else
+            A.viewLay = A.tidy.layout(root, x0, y0, tidyXGap, tidyYGap, maxTreeWidth, maxTreeHeight);
+    }
+    else {
+        A.viewLay = layoutTree(root, x0, y0, xGap, yGap, maxTreeWidth, maxTreeHeight);
+    }
+    A.viewLay.buildGrid();   // 点选用的网格只在布局重建时更新
 }
 
 // ===================== 绘制 =====================
@@ -1674,10 +1736,10 @@ static void drawTreeWithSelect(Node* root, const Layout& L, int clipX, int clipY
             auto it = varVals.find(p->ch);
             if (it != varVals.end()) {
                 char buf[48];
-                std::snprintf(buf, sizeof(buf), "%c=%.4g", p->ch, it->second);
+                std::snprintf(buf, sizeof(buf), "%s=%.4g", varNameFromCode(p->ch).c_str(), it->second);
                 return s2ws(buf);
             }
-            return s2ws(std::string(1, p->ch));
+            return s2ws(varNameFromCode(p->ch));
         }
         if (p->kind == 'F') {
             std::string fn = funcNameFromCode(p->ch);
@@ -1689,35 +1751,81 @@ static void drawTreeWithSelect(Node* root, const Layout& L, int clipX, int clipY
     int R = (int)(18 * zoom);
     if (R < 8) R = 8;
 
-    // 先画边
-    setlinecolor(RGB(120, 120, 120));
-    std::function<void(Node*)> edge = [&](Node* p) {
-        if (!p) return;
-        auto itp = L.pos.find(p);
-        if (itp == L.pos.end()) return;
-
-        int x1, y1;
-        scalePos(itp->second.x, itp->second.y, x1, y1);
-
-        if (p->l) {
-            auto it = L.pos.find(p->l);
-            if (it != L.pos.end()) {
-                int x2, y2;
-                scalePos(it->second.x, it->second.y, x2, y2);
-                line(x1, y1, x2, y2);
-            }
-        }
-        if (p->r) {
-            auto it = L.pos.find(p->r);
-            if (it != L.pos.end()) {
-                int x2, y2;
-                scalePos(it->second.x, it->second.y, x2, y2);
-                line(x1, y1, x2, y2);
-            }
-        }
-        edge(p->l); edge(p->r);
+    // 先按先序挑出要画的节点：
+    // - 整棵在视口外的子树跳过（剔除）
+    // - 屏幕上小于一个节点直径的子树（缩放越小越多）合并成一个聚合图形
+    // - 视口按半个半径分格，一格只画一个圆或聚合图形：与已画的圆几乎重合的节点不画圆，
+    //   落在已占用格子里的小子树整棵跳过
+    // 选中节点总会画出，包含它的子树也不会被合并；这样每帧的开销只取决于视口大小和可见部分，与整棵树的大小无关
+    int margin = R * 3;   // 圆、放大的已赋值变量和标签文字都在此范围内
+    int viewX0 = clipX - margin, viewX1 = clipX + clipW + margin;
+    int viewY0 = clipY - margin, viewY1 = clipY + clipH + margin;
+    int selIdx = L.indexOf(selected);
+
+    int cell = (std::max)(R / 2, 4);
+    int occCols = (viewX1 - viewX0) / cell + 1, occRows = (viewY1 - viewY0) / cell + 1;
+    std::vector<char> occupied((size_t)occCols * occRows, 0);
+    auto occupy = [&](int x, int y) -> bool {   // 占用 (x, y) 所在的格子，已被占用时返回 false
+        if (x < viewX0 || x > viewX1 || y < viewY0 || y > viewY1) return true;
+        char& c = occupied[(size_t)((y - viewY0) / cell) * occCols + (x - viewX0) / cell];
+        if (c) return false;
+        c = 1;
+        return true;
         };
-    edge(root);
+
+    struct Visible {
+        int i;
+        int x, y;       // 屏幕坐标
+        bool agg;       // 聚合图形（代表子树 [i, subtreeEnd[i])）
+        int x0, y0, x1, y1;
+    };
+    std::vector<Visible> vis;
+    struct Edge {
+        int parent, child;
+    };
+    std::vector<Edge> edges;
+    std::vector<std::pair<int, bool>> path;   // 当前节点的祖先链：(编号, 是否画了圆)
+
+    int n = (int)L.size();
+    for (int i = 0; i < n;) {
+        int bx0, by0, bx1, by1;
+        scalePos(L.boxX0[i], L.boxY0[i], bx0, by0);
+        scalePos(L.boxX1[i], L.boxY1[i], bx1, by1);
+        int end = L.subtreeEnd[i];
+        int x, y;
+        scalePos(L.x[i], L.y[i], x, y);
+        // 先序下父节点就是祖先链上最后一个仍包含 i 的节点
+        while (!path.empty() && L.subtreeEnd[path.back().first] <= i) path.pop_back();
+        bool parentDrawn = !path.empty() && path.back().second;
+
+        bool culled = bx1 < viewX0 || bx0 > viewX1 || by1 < viewY0 || by0 > viewY1;
+        bool hasSel = selIdx >= i && selIdx < end;
+        bool small = (bx1 - bx0) < 2 * R && (by1 - by0) < 2 * R;
+        bool agg = !culled && end - i > 1 && small && !hasSel;
+        bool drawn = !culled && (occupy(x, y) || i == selIdx);
+
+        // 两端都没画圆的边处在节点密集处，被周围的圆盖住，不画
+        if (L.parent[i] >= 0 && (parentDrawn || drawn)) edges.push_back({ L.parent[i], i });
+        if (drawn) vis.push_back({ i, x, y, agg, bx0, by0, bx1, by1 });
+
+        if (culled || agg) {
+            i = end;   // 整棵子树不可见，或已画成聚合图形
+            continue;
+        }
+        path.push_back({ i, drawn });
+        ++i;
+    }
+
+    // 先画边：被剔除子树的入边也可能伸进视口，按线段的包围盒再判断一次
+    setlinecolor(RGB(120, 120, 120));
+    for (const Edge& e : edges) {
+        int x1, y1, x2, y2;
+        scalePos(L.x[e.parent], L.y[e.parent], x1, y1);
+        scalePos(L.x[e.child], L.y[e.child], x2, y2);
+        if ((std::max)(x1, x2) < viewX0 || (std::min)(x1, x2) > viewX1 ||
+            (std::max)(y1, y2) < viewY0 || (std::min)(y1, y2) > viewY1) continue;
+        line(x1, y1, x2, y2);
+    }
 
     // 再画点
     int fontSize = (int)(FONT_NORMAL * zoom);
@@ -1725,13 +1833,24 @@ static void drawTreeWithSelect(Node* root, const Layout& L, int clipX, int clipY
     if (fontSize > 36) fontSize = 36;
     settextstyle(fontSize, 0, L"Microsoft YaHei");
 
-    std::function<void(Node*)> node = [&](Node* p) {
-        if (!p) return;
-        auto it = L.pos.find(p);
-        if (it == L.pos.end()) return;
-
-        int x, y;
-        scalePos(it->second.x, it->second.y, x, y);
+    // 按编号（先序）依次画点
+    for (const Visible& v : vis) {
+        int x = v.x, y = v.y;
+        if (v.agg) {
+            // 聚合图形：覆盖子树范围的圆角框，标出其中的节点数
+            int x0 = (std::min)(v.x0, x - R), x1 = (std::max)(v.x1, x + R);
+            int y0 = (std::min)(v.y0, y - R), y1 = (std::max)(v.y1, y + R);
+            setfillcolor(RGB(225, 235, 250));
+            setlinecolor(RGB(90, 120, 170));
+            solidroundrect(x0, y0, x1, y1, R, R);
+            roundrect(x0, y0, x1, y1, R, R);
+            std::wstring t = L"+" + std::to_wstring(L.subtreeEnd[v.i] - v.i);
+            setbkmode(TRANSPARENT);
+            settextcolor(RGB(40, 60, 110));
+            outtextxy((x0 + x1 - textwidth(t.c_str())) / 2, (y0 + y1 - textheight(t.c_str())) / 2, t.c_str());
+            continue;
+        }
+        Node* p = L.nodes[v.i];
 
         // 变量已赋值时用不同颜色
         bool isAssignedVar = (p->kind == 'V' && varVals.find(p->ch) != varVals.end());
@@ -1758,10 +1877,7 @@ static void drawTreeWithSelect(Node* root, const Layout& L, int clipX, int clipY
         setbkmode(TRANSPARENT);
         settextcolor(isAssignedVar ? RGB(0, 100, 0) : RGB(20, 20, 20));
         outtextxy(x - textwidth(t.c_str()) / 2, y - textheight(t.c_str()) / 2, t.c_str());
-
-        node(p->l); node(p->r);
-        };
-    node(root);
+    }
 }
 // ===================== 槽位化简功能 =====================
 // 显示模态输入对话框，输入数字
@@ -1830,188 +1946,203 @@ static void doUpdateTreeState(AppState& A) {
 
 // ===================== 绘制主界面 =====================
 // 绘制面板背景
-static void drawApp(AppState& A) {
+// 绘制界面：只重绘 dirty 标记的区域（各区域先画自己的背景，互不覆盖）
+static void drawApp(AppState& A, unsigned dirty = DIRTY_ALL) {
     BeginBatchDraw();
-    cleardevice();
+    if (dirty == DIRTY_ALL) cleardevice();
     setbkmode(TRANSPARENT);
 
     // ===== 左侧 =====
-    drawPanelBg(0, 0, A.leftW, A.H);
-
-    const int leftPad = 18;
-    const int titleY = 16;
-    int inputLabelY = A.tbInput.rc.y - 25;
-    int funcLabelY = A.funcView.y - 38;
-
-    // 先绘制功能区背景
-    setfillcolor(RGB(245, 245, 245));
-    solidrectangle(A.funcView.x - 2, A.funcView.y - 2, A.funcView.x + A.funcView.w + 2, A.funcView.y + A.funcView.h + 2);
+    if (dirty & DIRTY_LEFT) {
+        drawPanelBg(0, 0, A.leftW, A.H);
+
+        const int leftPad = 18;
+        const int titleY = 16;
+        int inputLabelY = A.tbInput.rc.y - 25;
+        int funcLabelY = A.funcView.y - 38;
+
+        // 先绘制功能区背景
+        setfillcolor(RGB(245, 245, 245));
+        solidrectangle(A.funcView.x - 2, A.funcView.y - 2, A.funcView.x + A.funcView.w + 2, A.funcView.y + A.funcView.h + 2);
+
+        // 绘制按钮（可能溢出）
+        for (const auto& b : A.funcBtns) {
+            // 只绘制与可视区域有交集的按钮
+            if (b.rc.y + b.rc.h < A.funcView.y) continue;
+            if (b.rc.y > A.funcView.y + A.funcView.h) continue;
+            b.draw();
+        }
 
-    // 绘制按钮（可能溢出）
-    for (const auto& b : A.funcBtns) {
-        // 只绘制与可视区域有交集的按钮
-        if (b.rc.y + b.rc.h < A.funcView.y) continue;
-        if (b.rc.y > A.funcView.y + A.funcView.h) continue;
-        b.draw();
-    }
+        // 用遮罩覆盖溢出的按钮内容
+        setfillcolor(RGB(248, 248, 248));
+        // 上方遮罩
+        solidrectangle(0, 0, A.leftW, A.funcView.y - 1);
+        // 下方遮罩
+        solidrectangle(0, A.funcView.y + A.funcView.h + 3, A.leftW, A.varPanel.y - 1);
 
-    // 用遮罩覆盖溢出的按钮内容
-    setfillcolor(RGB(248, 248, 248));
-    // 上方遮罩
-    solidrectangle(0, 0, A.leftW, A.funcView.y - 1);
-    // 下方遮罩
-    solidrectangle(0, A.funcView.y + A.funcView.h + 3, A.leftW, A.varPanel.y - 1);
+        // 重绘功能区边框
+        setlinecolor(RGB(210, 210, 210));
+        rectangle(A.funcView.x - 2, A.funcView.y - 2, A.funcView.x + A.funcView.w + 2, A.funcView.y + A.funcView.h + 2);
 
-    // 重绘功能区边框
-    setlinecolor(RGB(210, 210, 210));
-    rectangle(A.funcView.x - 2, A.funcView.y - 2, A.funcView.x + A.funcView.w + 2, A.funcView.y + A.funcView.h + 2);
+        // 重绘被遮罩覆盖的标题和标签
+        settextstyle(FONT_TITLE, 0, L"Microsoft YaHei");
+        settextcolor(RGB(30, 30, 30));
+        outtextxy(leftPad, titleY, L"后缀表达式（界面版）");
 
-    // 重绘被遮罩覆盖的标题和标签
-    settextstyle(FONT_TITLE, 0, L"Microsoft YaHei");
-    settextcolor(RGB(30, 30, 30));
-    outtextxy(leftPad, titleY, L"后缀表达式（界面版）");
+        settextstyle(FONT_NORMAL, 0, L"Microsoft YaHei");
+        outtextxy(leftPad, inputLabelY, L"输入后缀表达式：");
+        A.tbInput.draw("例：ab+c*   或   23+5*");
 
-    settextstyle(FONT_NORMAL, 0, L"Microsoft YaHei");
-    outtextxy(leftPad, inputLabelY, L"输入后缀表达式：");
-    A.tbInput.draw("例：ab+c*   或   23+5*");
+        settextstyle(FONT_SMALL, 0, L"Microsoft YaHei");
+        outtextxy(leftPad, funcLabelY, L"功能选择（滚轮可滑动）：");
 
-    settextstyle(FONT_SMALL, 0, L"Microsoft YaHei");
-    outtextxy(leftPad, funcLabelY, L"功能选择（滚轮可滑动）：");
+        drawVarPanel(A);
+    }
 
-    drawVarPanel(A);
     // ===== 右侧 =====
     int rx = A.leftW;
     int rw = A.W - A.leftW;
 
-    drawPanelBg(rx, 0, rw, A.H);
+    if (dirty == DIRTY_ALL) drawPanelBg(rx, 0, rw, A.H);
 
     const int pad = 18;
     const int titleH = 60;
     const int infoH = 180;
     const int statusH = 45;
-
-    // ---- ① 标题区 ----
-    drawPanelBg(rx, 0, rw, titleH);
-    settextstyle(FONT_TITLE, 0, L"Microsoft YaHei");
-    settextcolor(RGB(30, 30, 30));
-    outtextxy(rx + pad, 18, L"结果展示区");
-
-    // ---- ② 右侧结果区 ----
     int infoY = titleH;
-    drawPanelBg(rx, infoY-5, rw, infoH+5);
-    settextstyle(FONT_NORMAL, 0, L"Microsoft YaHei");
-    settextcolor(RGB(40, 40, 40));
 
-    std::vector<std::string> lines;
-    lines.push_back("当前表达式（中缀）：" + (A.hasCur ? A.cur.toInfix() : "<无>"));
-    lines.push_back("当前表达式（后缀）：" + (A.hasCur ? A.cur.postfixRaw : "<无>"));
-    lines.push_back("");
-    lines.push_back("最近求值结果： " + fmtDouble(A.lastValue));
-    lines.push_back("");
-    lines.push_back("槽位列表：");
-    for (int i = 0; i < (int)A.slots.size(); ++i) {
-        std::string s = "  槽位" + std::to_string(i + 1) + "：";
-        if (A.hasSlot[i]) {
-            // 中缀和后缀放在同一行
-            s += "中缀:    " + A.slots[i].toInfix() + "                            "+ "后缀:     " + A.slots[i].postfixRaw;
-        }
-        else {
-            s += "<空>";
+    if (dirty & DIRTY_INFO) {
+        // ---- ① 标题区 ----
+        drawPanelBg(rx, 0, rw, titleH);
+        settextstyle(FONT_TITLE, 0, L"Microsoft YaHei");
+        settextcolor(RGB(30, 30, 30));
+        outtextxy(rx + pad, 18, L"结果展示区");
+
+        // ---- ② 右侧结果区 ----
+        drawPanelBg(rx, infoY-5, rw, infoH+5);
+        settextstyle(FONT_NORMAL, 0, L"Microsoft YaHei");
+        settextcolor(RGB(40, 40, 40));
+
+        std::vector<std::string> lines;
+        lines.push_back("当前表达式（中缀）：" + (A.hasCur ? A.cur.infixCache : "<无>"));
+        lines.push_back("当前表达式（后缀）：" + (A.hasCur ? A.cur.postfixRaw : "<无>"));
+        lines.push_back("");
+        lines.push_back("最近求值结果： " + fmtDouble(A.lastValue));
+        lines.push_back("");
+        lines.push_back("槽位列表：");
+        for (int i = 0; i < (int)A.slots.size(); ++i) {
+            std::string s = "  槽位" + std::to_string(i + 1) + "：";
+            if (A.hasSlot[i]) {
+                // 中缀和后缀放在同一行
+                s += "中缀:    " + A.slots[i].infixCache + "                            "+ "后缀:     " + A.slots[i].postfixRaw;
+            }
+            else {
+                s += "<空>";
+            }
+            lines.push_back(s);
         }
-        lines.push_back(s);
-    }
 
-    const int lineH = 24;
-    const int topPad = 10;
-    const int bottomPad = 10;
+        const int lineH = 24;
+        const int topPad = 10;
+        const int bottomPad = 10;
 
-    int contentH = (int)lines.size() * lineH;
-    int viewH = infoH - topPad - bottomPad;
+        int contentH = (int)lines.size() * lineH;
+        int viewH = infoH - topPad - bottomPad;
 
-    const int maxY = 0;
-    int minY = viewH - contentH;     // content 比视口高时 minY 为负数
-    if (minY > 0) minY = 0;          // content 比视口矮时，不允许滚动，minY 固定 0
+        const int maxY = 0;
+        int minY = viewH - contentH;     // content 比视口高时 minY 为负数
+        if (minY > 0) minY = 0;          // content 比视口矮时，不允许滚动，minY 固定 0
 
-    A.rightScrollMin = minY;
+        A.rightScrollMin = minY;
 
-    // 关键：当不需要滚动时，直接锁死为 0（防止上滑“飘”）
-    if (contentH <= viewH) {
-        A.rightScrollY = 0;
-    }
-    else {
-        if (A.rightScrollY < minY) A.rightScrollY = minY;
-        if (A.rightScrollY > maxY) A.rightScrollY = maxY;
-    }
+        // 关键：当不需要滚动时，直接锁死为 0（防止上滑“飘”）
+        if (contentH <= viewH) {
+            A.rightScrollY = 0;
+        }
+        else {
+            if (A.rightScrollY < minY) A.rightScrollY = minY;
+            if (A.rightScrollY > maxY) A.rightScrollY = maxY;
+        }
 
 
-    int baseY = infoY + topPad + A.rightScrollY;
-    for (int i = 0; i < (int)lines.size(); ++i) {
-        int yy = baseY + i * lineH;
-        if (yy < infoY + topPad - lineH) continue;
-        if (yy > infoY + infoH - bottomPad) break;
-        outtextxy(rx + pad, yy, s2ws(lines[i]).c_str());
-    }
+        int baseY = infoY + topPad + A.rightScrollY;
+        for (int i = 0; i < (int)lines.size(); ++i) {
+            int yy = baseY + i * lineH;
+            if (yy < infoY + topPad - lineH) continue;
+            if (yy > infoY + infoH - bottomPad) break;
+            outtextxy(rx + pad, yy, s2ws(lines[i]).c_str());
+        }
 
-    settextstyle(FONT_SMALL, 0, L"Microsoft YaHei");
-    settextcolor(RGB(120, 120, 120));
-    outtextxy(rx + rw - 220, infoY + infoH - 28, L"滚轮：滚动结果区");
+        settextstyle(FONT_SMALL, 0, L"Microsoft YaHei");
+        settextcolor(RGB(120, 120, 120));
+        outtextxy(rx + rw - 220, infoY + infoH - 28, L"滚轮：滚动结果区");
 
-    if (contentH > viewH) {
-        int barX = rx + rw - 10;
-        int barY0 = infoY + topPad;
-        int barH = viewH;
+        if (contentH > viewH) {
+            int barX = rx + rw - 10;
+            int barY0 = infoY + topPad;
+            int barH = viewH;
 
-        setfillcolor(RGB(230, 230, 230));
-        solidrectangle(barX, barY0, barX + 4, barY0 + barH);
+            setfillcolor(RGB(230, 230, 230));
+            solidrectangle(barX, barY0, barX + 4, barY0 + barH);
 
-        double ratio = (double)viewH / (double)contentH;
-        int thumbH = (int)(barH * ratio);
-        if (thumbH < 18) thumbH = 18;
+            double ratio = (double)viewH / (double)contentH;
+            int thumbH = (int)(barH * ratio);
+            if (thumbH < 18) thumbH = 18;
 
-        double t = (A.rightScrollMin == 0) ? 0.0 : (double)(-A.rightScrollY) / (double)(-A.rightScrollMin);
-        int thumbY = barY0 + (int)((barH - thumbH) * t);
+            double t = (A.rightScrollMin == 0) ? 0.0 : (double)(-A.rightScrollY) / (double)(-A.rightScrollMin);
+            int thumbY = barY0 + (int)((barH - thumbH) * t);
 
-        setfillcolor(RGB(160, 160, 160));
-        solidrectangle(barX, thumbY, barX + 4, thumbY + thumbH);
+            setfillcolor(RGB(160, 160, 160));
+            solidrectangle(barX, thumbY, barX + 4, thumbY + thumbH);
+        }
     }
 
     // ---- ④ 状态栏 ----
     int statusY = A.H - statusH;
-    drawPanelBg(rx, statusY, rw, statusH);
-    settextstyle(FONT_NORMAL, 0, L"Microsoft YaHei");
-    settextcolor(RGB(60, 60, 60));
-    outtextxy(rx + pad, statusY + 12, s2ws("状态： " + A.status).c_str());
+    if (dirty & DIRTY_STATUS) {
+        drawPanelBg(rx, statusY, rw, statusH);
+        settextstyle(FONT_NORMAL, 0, L"Microsoft YaHei");
+        settextcolor(RGB(60, 60, 60));
+        outtextxy(rx + pad, statusY + 12, s2ws("状态： " + A.status).c_str());
+    }
 
     // ---- ③ 树绘图区 ----
     int treeY = infoY + infoH;
     int treeH = statusY - treeY;
-    drawPanelBg(rx, treeY, rw, treeH);
+    if (dirty & DIRTY_TREE) {
+        // 树可以拖出绘图区，裁剪到本区域，避免画到其他区域上（那些区域不一定随树一起重绘）
+        HRGN treeRgn = CreateRectRgn(rx, treeY, rx + rw + 1, statusY);
+        setcliprgn(treeRgn);
+        DeleteObject(treeRgn);
+        drawPanelBg(rx, treeY, rw, treeH);
 
-    settextstyle(FONT_NORMAL, 0, L"Microsoft YaHei");
-    settextcolor(RGB(40, 40, 40));
+        settextstyle(FONT_NORMAL, 0, L"Microsoft YaHei");
+        settextcolor(RGB(40, 40, 40));
     
-    // 显示当前树视图来源
-    std::wstring treeTitle = L"表达式二叉树";
-    if (A.viewTreeIdx == -1) {
-        treeTitle += L"（当前表达式）";
-    } else {
-        treeTitle += L"（槽位" + std::to_wstring(A.viewTreeIdx + 1) + L"）";
-    }
-    treeTitle += L" - 点击节点可选中";
-    outtextxy(rx + pad, treeY + 10, treeTitle.c_str());
-    // 使用 viewLay 和 GetViewRoot 绘制树（传入缩放比例和偏移量）
+        // 显示当前树视图来源
+        std::wstring treeTitle = L"表达式二叉树";
+        if (A.viewTreeIdx == -1) {
+            treeTitle += L"（当前表达式）";
+        } else {
+            treeTitle += L"（槽位" + std::to_wstring(A.viewTreeIdx + 1) + L"）";
+        }
+        treeTitle += L" - 点击节点可选中";
+        outtextxy(rx + pad, treeY + 10, treeTitle.c_str());
+        // 使用 viewLay 和 GetViewRoot 绘制树（传入缩放比例和偏移量）
 
-    Node* viewRoot = GetViewRoot(A);
-    drawTreeWithSelect(viewRoot, A.viewLay, rx, treeY + 40, rw, treeH - 40,
-        A.selectedNode, A.varVals,  // ★传入变量值映射
-        A.treeZoom, A.treeOffsetX, A.treeOffsetY);
+        Node* viewRoot = GetViewRoot(A);
+        drawTreeWithSelect(viewRoot, A.viewLay, rx, treeY + 40, rw, treeH - 40,
+            A.selectedNode, A.varVals,  // ★传入变量值映射
+            A.treeZoom, A.treeOffsetX, A.treeOffsetY);
 
-    // 显示缩放比例和拖动提示
-    settextstyle(FONT_SMALL, 0, L"Microsoft YaHei");
-    settextcolor(RGB(120, 120, 120));
-    char zoomBuf[64];
-    std::snprintf(zoomBuf, sizeof(zoomBuf), "缩放: %.0f%% | 拖动: 按住拖拽", A.treeZoom * 100);
-    outtextxy(rx + rw - 200, treeY + 10, s2ws(zoomBuf).c_str());
+        // 显示缩放比例和拖动提示
+        settextstyle(FONT_SMALL, 0, L"Microsoft YaHei");
+        settextcolor(RGB(120, 120, 120));
+        char zoomBuf[64];
+        std::snprintf(zoomBuf, sizeof(zoomBuf), "缩放: %.0f%% | 拖动: 按住拖拽", A.treeZoom * 100);
+        outtextxy(rx + rw - 200, treeY + 10, s2ws(zoomBuf).c_str());
+        setcliprgn(NULL);
+    }
 
 	FlushBatchDraw();  // 提交绘制
 
@@ -2039,11 +2170,7 @@ static void doSimplifySlotToSlot(AppState& A) {
 
     tmp.simplify();  // simplify 内部会调用 updateCaches()
 
-    A.slots[dst].clear();
-    A.slots[dst].root = tmp.root;
-    A.slots[dst].postfixRaw = tmp.postfixRaw;  // 使用更新后的后缀
-    A.slots[dst].infixCache = tmp.infixCache;  // 使用更新后的中缀
-    tmp.root = nullptr;
+    A.slots[dst].takeFrom(tmp);  // 接管化简结果（含更新后的后缀/中缀和内存池）
     A.hasSlot[dst] = true;
 
     RebuildViewLayout(A);
@@ -2132,26 +2259,37 @@ int main() {
 
     bool full = false;
     ExMessage msg{};
+    const BYTE msgFilter = EM_MOUSE | EM_KEY | EM_CHAR;
+    int caretPhase = -1;   // 输入框光标的闪烁相位（见 TextBox::draw）
 
     while (true) {
-        POINT pt;
-        GetCursorPos(&pt);
-        ScreenToClient(GetHWnd(), &pt);
-        int mx = pt.x, my = pt.y;
+        // 输入框激活时光标每 500ms 闪烁一次，相位变化时重绘左侧
+        bool blinking = A.tbInput.active && !A.tbInput.hasSelection();
+        int phase = blinking ? (int)((GetTickCount() / 500) % 2) : -1;
+        if (phase != caretPhase) {
+            caretPhase = phase;
+            A.dirty |= DIRTY_LEFT;
+        }
 
-        // 只有在 funcView 范围内才显示悬停效果
-        for (auto& b : A.funcBtns) {
-            if (hitRect(A.funcView, mx, my)) {
-                b.hot = b.hit(mx, my);
-            }
-            else {
-                b.hot = false;
-            }
+        if (A.dirty) {
+            drawApp(A, A.dirty);
+            A.dirty = 0;
         }
 
-        drawApp(A);
+        // 取下一条消息：空闲时阻塞等待；光标闪烁期间没有消息就阻塞到有输入或本次相位结束（最多 500ms）
+        if (blinking) {
+            if (!peekmessage(&msg, msgFilter)) {
+                DWORD left = 500 - GetTickCount() % 500;
+                MsgWaitForMultipleObjects(0, nullptr, FALSE, left, QS_ALLINPUT);
+                continue;
+            }
+        }
+        else {
+            getmessage(&msg, msgFilter);
+        }
 
-        while (peekmessage(&msg, EM_MOUSE | EM_KEY | EM_CHAR)) {
+        // 处理这一条以及已经排队的所有消息，最后只重绘一次
+        do {
             if (msg.message == WM_MOUSEWHEEL) {
                 int rx = A.leftW;
                 int rw = A.W - A.leftW;
@@ -2174,6 +2312,7 @@ int main() {
 
                     if (A.rightScrollY > 0) A.rightScrollY = 0;
                     if (A.rightScrollY < A.rightScrollMin) A.rightScrollY = A.rightScrollMin;
+                    A.dirty |= DIRTY_INFO;
                 }
                 else if (hitRect(treeRect, msg.x, msg.y)) {
                     // 树区域缩放
@@ -2187,15 +2326,19 @@ int main() {
                         if (A.treeZoom < A.ZOOM_MIN) A.treeZoom = A.ZOOM_MIN;
                     }
                     A.status = "缩放: " + std::to_string((int)(A.treeZoom * 100)) + "%";
+                    A.dirty |= DIRTY_TREE | DIRTY_STATUS;
                 }
                 else if (hitRect(A.funcView, msg.x, msg.y)) {
                     // 左侧按钮区滚动
                     int delta = (int)msg.wheel;
                     if (delta > 0) scrollFunc(A, -40);
                     else if (delta < 0) scrollFunc(A, 40);
+                    updateHover(A, msg.x, msg.y);
+                    A.dirty |= DIRTY_LEFT;
                 }
             }
             else if (msg.message == WM_LBUTTONDOWN) {
+                A.dirty |= DIRTY_LEFT;   // 输入框焦点、按钮按下、变量选中
                 // 输入框鼠标按下
                 if (A.tbInput.hit(msg.x, msg.y)) {
                     A.tbInput.activate();
@@ -2236,9 +2379,12 @@ int main() {
                 }
             }
             else if (msg.message == WM_MOUSEMOVE) {
+                // 按钮悬停状态变化时才重绘
+                if (updateHover(A, msg.x, msg.y)) A.dirty |= DIRTY_LEFT;
                 // 输入框拖选
                 if (A.tbInput.selecting) {
                     A.tbInput.onMouseMove(msg.x, msg.y);
+                    A.dirty |= DIRTY_LEFT;
                 }
                 // 处理树拖动
                 if (A.treeDragging) {
@@ -2248,11 +2394,13 @@ int main() {
                     A.treeOffsetY += dy;
                     A.treeDragStartX = msg.x;
                     A.treeDragStartY = msg.y;
+                    if (dx || dy) A.dirty |= DIRTY_TREE;
                 }
             }
             else if (msg.message == WM_LBUTTONUP) {
                 // 输入框鼠标释放
                 A.tbInput.onMouseUp(msg.x, msg.y);
+                A.dirty |= DIRTY_LEFT;
 
                 bool wasDragging = A.treeDragging;
                 int dragDistX = std::abs(msg.x - A.treeDragStartX);
@@ -2279,6 +2427,7 @@ int main() {
                         if (hit) {
                             A.selectedNode = hit;
                             A.status = "已选中子表达式，可点击 sin/cos/tan 包裹";
+                            A.dirty |= DIRTY_TREE | DIRTY_STATUS;
                         }
                     }
                 }
@@ -2308,6 +2457,8 @@ int main() {
 
                 int idx = clickedIndex();
                 if (idx != -1) {
+                    // 功能可能改动任意状态（也可能弹出过模态对话框覆盖了界面），整体重绘
+                    A.dirty = DIRTY_ALL;
                     switch (idx) {
                     case 0:  doBuild(A); RebuildViewLayout(A); break;
                     case 1:  doShowInfix(A); break;
@@ -2316,23 +2467,30 @@ int main() {
                     case 4:  doSaveCurToSlot(A); RebuildViewLayout(A); break;
                     case 5:  doComposeFromSlotsBest(A); RebuildViewLayout(A); break;
                     case 6:  doDerivativeToSlot(A); RebuildViewLayout(A); break;
-                    case 7:  doWrapFunc(A, "sin"); RebuildViewLayout(A); break;
-                    case 8:  doWrapFunc(A, "cos"); RebuildViewLayout(A); break;
-                    case 9:  doWrapFunc(A, "tan"); RebuildViewLayout(A); break;
+                    case 7:  doWrapFunc(A, "sin"); RebuildViewLayout(A, true); break;
+                    case 8:  doWrapFunc(A, "cos"); RebuildViewLayout(A, true); break;
+                    case 9:  doWrapFunc(A, "tan"); RebuildViewLayout(A, true); break;
                     case 10: doSimplifySlotToSlot(A); break;
                     case 11: doUpdateTreeState(A); break;
                     case 12: DoUndo(A); RebuildViewLayout(A); break;
-                    case 13: doClear(A); A.viewLay.pos.clear(); A.viewTreeIdx = -1; break;
+                    case 13: doClear(A); A.viewLay.clear(); A.viewTreeIdx = -1; break;
                     case 14:
                         toggleFullscreen(A, full);
                         break;
+                    case 15:
+                        A.layoutMode = (A.layoutMode == LAYOUT_TIDY) ? LAYOUT_CLASSIC : LAYOUT_TIDY;
+                        RebuildViewLayout(A);
+                        A.status = (A.layoutMode == LAYOUT_TIDY) ? "树布局：紧凑（Reingold-Tilford）" : "树布局：经典";
+                        break;
                     }
                 }
             }
             else if (msg.message == WM_CHAR) {
                 A.tbInput.onChar((int)msg.ch);
+                A.dirty |= DIRTY_LEFT;
             }
             else if (msg.message == WM_KEYDOWN) {
+                A.dirty |= DIRTY_LEFT;
                 //★获取 Shift 和 Ctrl 状态
                 bool shift = (GetKeyState(VK_SHIFT) & 0x8000) != 0;
                 bool ctrl = (GetKeyState(VK_CONTROL) & 0x8000) != 0;
@@ -2347,9 +2505,11 @@ int main() {
                 if (msg.vkcode == VK_RETURN) {
                     doBuild(A);
                     RebuildViewLayout(A);
+                    A.dirty = DIRTY_ALL;
                 }
                 if (msg.vkcode == VK_F11) {
                     toggleFullscreen(A, full);
+                    A.dirty = DIRTY_ALL;
                 }
                 // 只有输入框未激活时，上下键才滚动按钮列表
                 if (!A.tbInput.active) {
@@ -2357,7 +2517,6 @@ int main() {
                     if (msg.vkcode == VK_DOWN) scrollFunc(A, 40);
                 }
                 }
-        }
-        Sleep(10);
+        } while (peekmessage(&msg, msgFilter));
     }
 }
@@ -7,7 +7,29 @@
 #include <set>
 #include <cmath>
 #include <functional>
-#include <sstream>
+#include <algorithm>
+#include <ostream>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+//  std::to_chars Ҫ C++17 ׼֧֣ʱָʽ˻ snprintf
+#if defined(__has_include) && (__cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L))
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+#define PPE_HAS_TO_CHARS 1
+#else
+#define PPE_HAS_TO_CHARS 0
+#endif
 
 using std::string;
 using std::vector;
@@ -16,30 +38,131 @@ using std::vector;
 struct Node {
     char kind;    // 'N' , 'V' , 'O' , 'F' һԪ
     char ch;      // //(s/c/t/l)
+    bool inArena; // Ƿ NodeArena 䣨 arena գܵ delete
+    int layoutIdx; // һβеıţ Layout-1 ʾδ֣ռö϶ڵ㣩
     double num;   // 
 	Node* l;      // ӽڵ
 	Node* r;      // ӽڵ
-	Node() : kind('N'), ch(0), num(0), l(nullptr), r(nullptr) {} // ĬϹ캯
+	Node() : kind('N'), ch(0), inArena(false), layoutIdx(-1), num(0), l(nullptr), r(nullptr) {} // ĬϹ캯
+};
+
+// ===================== ڵڴأarena =====================
+
+// Էڵڴأ䣬reset() һԻȫڵ㣨ڴԱ㸴ã
+struct NodeArena {
+    NodeArena() = default;
+    NodeArena(const NodeArena&) = delete;
+    NodeArena& operator=(const NodeArena&) = delete;
+    ~NodeArena() {
+        for (auto& b : blocks) ::operator delete(b.mem);
+    }
+
+    // һĬϳʼĽڵ
+    Node* alloc() {
+        if (cur >= blocks.size() || used == blocks[cur].cap) nextBlock();
+        Node* p = new (blocks[cur].mem + used) Node();
+        ++used;
+        ++count;
+        p->inArena = true;
+        return p;
+    }
+
+    // ȫڵ㣨Node Ϊƽ
+    void reset() {
+        cur = 0;
+        used = 0;
+        count = 0;
+    }
+
+    // ϴ reset Ľڵ
+    size_t size() const { return count; }
+
+private:
+    struct Block {
+        Node* mem;
+        size_t cap;
+    };
+
+    // лһ飻ûппʱ¿
+    void nextBlock() {
+        if (!blocks.empty() && used > 0) ++cur;
+        used = 0;
+        if (cur < blocks.size()) return;
+        size_t cap = blocks.empty() ? 64 : (std::min)(blocks.back().cap * 2, (size_t)65536);
+        blocks.push_back({ static_cast<Node*>(::operator new(sizeof(Node) * cap)), cap });
+        cur = blocks.size() - 1;
+    }
+
+    vector<Block> blocks;
+    size_t cur = 0;     // ǰ±
+    size_t used = 0;    // ǰýڵ
+    size_t count = 0;   // ѷڵ
+};
+
+// ǰ̵߳Ŀ arenaΪʱڵӶ new
+inline NodeArena*& currentNodeArena() {
+    thread_local NodeArena* cur = nullptr;
+    return cur;
+}
+
+// ½Ľڵ㶼䵽ָ arena
+struct NodeArenaScope {
+    explicit NodeArenaScope(NodeArena* a) : prev(currentNodeArena()) { currentNodeArena() = a; }
+    ~NodeArenaScope() { currentNodeArena() = prev; }
+    NodeArenaScope(const NodeArenaScope&) = delete;
+    NodeArenaScope& operator=(const NodeArenaScope&) = delete;
+private:
+    NodeArena* prev;
 };
 
 // ===================== ڴ =====================
 
+// һ½ڵ㣺еǰ arena ʱ arena 䣬Ӷ new
+inline Node* allocNode() {
+    NodeArena* a = currentNodeArena();
+    return a ? a->alloc() : new Node();
+}
+
+// ͷŵڵ㣺arena ڵ arena գﲻ
+inline void releaseNode(Node* p) {
+    if (p && !p->inArena) delete p;
+}
+
+// 㷨ʹʽջƣʽʽҲջ
+
 // ͷűʽнڵ
+// arena ڵ֮²Ҷѽڵ㣬 arena ڵ㼴ֹͣ arena ͷΪ O(1)
 inline void freeTree(Node* p) {
-    if (!p) return;
-    freeTree(p->l);
-    freeTree(p->r);
-    delete p;
+    vector<Node*> st;
+    if (p && !p->inArena) st.push_back(p);
+    while (!st.empty()) {
+        Node* q = st.back();
+        st.pop_back();
+        if (q->l && !q->l->inArena) st.push_back(q->l);
+        if (q->r && !q->r->inArena) st.push_back(q->r);
+        delete q;
+    }
 }
 
-// һñʽ
+// һñʽ䣬 arena еĲݹ鿽ͬ
 inline Node* cloneTree(Node* p) {
-    if (!p) return nullptr;
-    Node* q = new Node();
-    *q = *p;
-    q->l = cloneTree(p->l);
-    q->r = cloneTree(p->r);
-    return q;
+    Node* root = nullptr;
+    vector<std::pair<Node*, Node**>> st;  // (Դڵ, ½ڵӦдλ)
+    st.push_back({ p, &root });
+    while (!st.empty()) {
+        Node* src = st.back().first;
+        Node** dst = st.back().second;
+        st.pop_back();
+        if (!src) { *dst = nullptr; continue; }
+        Node* q = allocNode();
+        q->kind = src->kind;
+        q->ch = src->ch;
+        q->num = src->num;
+        *dst = q;
+        st.push_back({ src->r, &q->r });
+        st.push_back({ src->l, &q->l });
+    }
+    return root;
 }
 
 // ===================== /루֧ sin/cos/tan/ln =====================
@@ -62,11 +185,384 @@ inline std::string funcNameFromCode(char c) {
     return "func?";
 }
 
+// ===================== /루ֶַ֧ =====================
+
+// ĸıֱøĸ룻ַǼǵֱη 0x80 ı
+//  Node::chstd::map<char, double> Ƚӿһ char ʾ
+// һֱǼ VAR_CODE_MAX ַֻͬһű
+// ĬʹýڹֱVarNameScope Ըǰ̻߳һԼı
+// ʽÿ¼ѱػؼ¼ʼǰĴСʱʱֱ
+const int VAR_CODE_BASE = 0x80;
+const int VAR_CODE_MAX = 128;   // һֱɵǼǵĶַ
+
+class VarNameTable {
+public:
+    // ת루ֱǶַʱ 0
+    char code(const char* s, size_t len) {
+        size_t h = hashName(s, len);
+        auto range = index.equal_range(h);
+        for (auto it = range.first; it != range.second; ++it) {
+            const string& n = names[(size_t)it->second];
+            if (n.size() == len && std::memcmp(n.data(), s, len) == 0) return (char)(VAR_CODE_BASE + it->second);
+        }
+        if ((int)names.size() >= VAR_CODE_MAX) return 0;
+        names.push_back(string(s, len));
+        index.emplace(h, (int)names.size() - 1);
+        return (char)(VAR_CODE_BASE + names.size() - 1);
+    }
+
+    // ת֣ǱǼǵıʱ nullptr
+    const string* name(char c) const {
+        int idx = (unsigned char)c - VAR_CODE_BASE;
+        if (idx < 0 || idx >= (int)names.size()) return nullptr;
+        return &names[(size_t)idx];
+    }
+
+    size_t size() const { return names.size(); }
+
+    // ֻȵǼǵ n ֣֮ıʧЧ
+    void truncate(size_t n) {
+        while (names.size() > n) {
+            size_t h = hashName(names.back().data(), names.back().size());
+            auto range = index.equal_range(h);
+            for (auto it = range.first; it != range.second; ++it) {
+                if (it->second == (int)names.size() - 1) { index.erase(it); break; }
+            }
+            names.pop_back();
+        }
+    }
+
+    void clear() { truncate(0); }
+
+private:
+    static size_t hashName(const char* s, size_t len) {
+        uint64_t h = 14695981039346656037ULL;   // FNV-1a
+        for (size_t i = 0; i < len; ++i) h = (h ^ (unsigned char)s[i]) * 1099511628211ULL;
+        return (size_t)h;
+    }
+
+    vector<string> names;                        // names[i] ıΪ VAR_CODE_BASE + i
+    std::unordered_multimap<size_t, int> index;  // ֵĹϣ -> ±
+};
+
+// ڹֱ
+struct SharedVarNames {
+    std::mutex m;
+    VarNameTable table;
+};
+
+inline SharedVarNames& sharedVarNames() {
+    static SharedVarNames t;
+    return t;
+}
+
+// ǰ߳ʹõֱΪʱʹù
+inline VarNameTable*& currentVarNames() {
+    thread_local VarNameTable* cur = nullptr;
+    return cur;
+}
+
+// ڵı/붼ʹֱָ
+struct VarNameScope {
+    explicit VarNameScope(VarNameTable* t) : prev(currentVarNames()) { currentVarNames() = t; }
+    ~VarNameScope() { currentVarNames() = prev; }
+    VarNameScope(const VarNameScope&) = delete;
+    VarNameScope& operator=(const VarNameScope&) = delete;
+private:
+    VarNameTable* prev;
+};
+
+// ǰֱ߳ĸµֱԤȵǼе֣뱣ֲ䣩
+inline VarNameTable snapshotVarNames() {
+    if (VarNameTable* t = currentVarNames()) return *t;
+    SharedVarNames& g = sharedVarNames();
+    std::lock_guard<std::mutex> lk(g.m);
+    return g.table;
+}
+
+// ת룬ֱʱ 0
+inline char varCodeFromName(const char* s, size_t len) {
+    if (len == 1 && ((s[0] >= 'a' && s[0] <= 'z') || (s[0] >= 'A' && s[0] <= 'Z')))
+        return s[0];
+    if (VarNameTable* t = currentVarNames()) return t->code(s, len);
+    SharedVarNames& g = sharedVarNames();
+    std::lock_guard<std::mutex> lk(g.m);
+    return g.table.code(s, len);
+}
+
+inline char varCodeFromName(const std::string& name) {
+    return varCodeFromName(name.data(), name.size());
+}
+
+// ת
+inline std::string varNameFromCode(char c) {
+    if ((unsigned char)c >= VAR_CODE_BASE) {
+        if (VarNameTable* t = currentVarNames()) {
+            if (const string* n = t->name(c)) return *n;
+        }
+        else {
+            SharedVarNames& g = sharedVarNames();
+            std::lock_guard<std::mutex> lk(g.m);
+            if (const string* n = g.table.name(c)) return *n;
+        }
+    }
+    return std::string(1, c);
+}
+
+// ׺ʽпֱдıСдĸд [name]
+inline bool isBareVarCode(char c) {
+    return c >= 'a' && c <= 'z';
+}
+
+// ===================== ָʽ =====================
+
+// ıĴС㹻 double ͽβ '\0'
+const size_t NUMBER_BUF_SIZE = 32;
+
+// תı֤ strtod ܾȷԭس
+//  std::to_chars ʱܾȷԭʽ 15 λЧ֣ 17 λ
+inline int formatNumberExact(double v, char* buf, size_t size) {
+#if PPE_HAS_TO_CHARS
+    std::to_chars_result res = std::to_chars(buf, buf + size - 1, v);
+    if (res.ec == std::errc()) {
+        *res.ptr = '\0';
+        return (int)(res.ptr - buf);
+    }
+#endif
+    int n = std::snprintf(buf, size, "%.15g", v);
+    if (v == v && std::strtod(buf, nullptr) != v) n = std::snprintf(buf, size, "%.17g", v);
+    return n;
+}
+
+// ===================== ׺Ǻʶ =====================
+
+// s[i..n) ԺͷʱֳȲд룬򷵻 0
+inline size_t matchFuncName(const char* s, size_t n, size_t i, char& code) {
+    static const char* names[] = { "sin", "cos", "tan", "ln" };
+    for (const char* name : names) {
+        size_t len = std::strlen(name);
+        if (n - i >= len && std::memcmp(s + i, name, len) == 0) {
+            code = funcCodeFromName(name);
+            return len;
+        }
+    }
+    return 0;
+}
+
+// ǷΪϷĶַĸ»߿ͷĸ֡»
+inline bool isIdentifier(const char* s, size_t n) {
+    if (n == 0) return false;
+    for (size_t i = 0; i < n; ++i) {
+        char c = s[i];
+        bool alpha = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+        bool digit = (c >= '0' && c <= '9');
+        if (!alpha && !(digit && i > 0)) return false;
+    }
+    return true;
+}
+
+// ===================== л =====================
+
+// Ŀ꣺׷ӵ÷ṩ string
+struct StringSink {
+    explicit StringSink(string& s) : out(s) {}
+    void put(char c) { out += c; }
+    void write(const char* p, size_t n) { out.append(p, n); }
+    string& out;
+};
+
+// Ŀ꣺д̶СĻ壬дʽȷڴ棩
+struct StreamSink {
+    explicit StreamSink(std::ostream& s) : os(s) {}
+    ~StreamSink() { flush(); }
+    StreamSink(const StreamSink&) = delete;
+    StreamSink& operator=(const StreamSink&) = delete;
+
+    void put(char c) {
+        if (len == sizeof(buf)) flush();
+        buf[len++] = c;
+    }
+    void write(const char* p, size_t n) {
+        if (len + n > sizeof(buf)) {
+            flush();
+            if (n > sizeof(buf)) { os.write(p, (std::streamsize)n); return; }
+        }
+        std::memcpy(buf + len, p, n);
+        len += n;
+    }
+    void flush() {
+        if (len) os.write(buf, (std::streamsize)len);
+        len = 0;
+    }
+
+    std::ostream& os;
+    char buf[4096];
+    size_t len = 0;
+};
+
+// ͳĽڵԤȣ
+inline size_t treeNodeCount(Node* root) {
+    thread_local vector<Node*> st;
+    st.clear();
+    size_t n = 0;
+    if (root) st.push_back(root);
+    while (!st.empty()) {
+        Node* p = st.back();
+        st.pop_back();
+        ++n;
+        if (p->l) st.push_back(p->l);
+        if (p->r) st.push_back(p->r);
+    }
+    return n;
+}
+
+// ׺УǰĩβַΪ t0 t1 ʱд wĸǰǷҪһո
+// ǰĩβСдĸ w Ŀͷܱƴɺʱ ln ƴ lnҪ
+inline bool postfixNeedsSpace(char t0, char t1, const char* w, size_t len) {
+    auto lower = [](char c) { return c >= 'a' && c <= 'z'; };
+    size_t back = lower(t1) ? (lower(t0) ? 2 : 1) : 0;
+    if (!back) return false;
+    const char tail[2] = { t0, t1 };
+    char buf[5];
+    size_t take = len < 3 ? len : 3;
+    std::memcpy(buf, tail + 2 - back, back);
+    std::memcpy(buf + back, w, take);
+    for (size_t i = 0; i < back; ++i) {
+        char code;
+        size_t m = matchFuncName(buf, back + take, i, code);
+        if (m && i + m > back) return true;
+    }
+    return false;
+}
+
+// ׺  
+//  0~9 дһλ֣дɿɾȷԭ []ĸıд [name]
+// ջ̸߳ãÿڵֻһΣܺʱڽڵ
+template <class Sink>
+inline void serializePostfix(Node* root, Sink& out) {
+    char tail[2] = { 0, 0 };   // ַtail[1] Ϊһ
+    auto emit = [&](const char* s, size_t n) {
+        if (n == 0) return;
+        out.write(s, n);
+        tail[0] = n >= 2 ? s[n - 2] : tail[1];
+        tail[1] = s[n - 1];
+    };
+    auto emitChar = [&](char c) {
+        out.put(c);
+        tail[0] = tail[1];
+        tail[1] = c;
+    };
+    // ׷ӵĸҪʱȲָո
+    auto emitWord = [&](const char* w, size_t len) {
+        if (postfixNeedsSpace(tail[0], tail[1], w, len)) emitChar(' ');
+        if (len == 1) emitChar(w[0]);
+        else emit(w, len);
+    };
+
+    thread_local vector<std::pair<Node*, bool>> st;  // (ڵ, ӽڵǷ)
+    st.clear();
+    st.push_back({ root, false });
+    while (!st.empty()) {
+        Node* p = st.back().first;
+        bool expanded = st.back().second;
+        st.pop_back();
+        if (!p) continue;
+        if (p->kind == 'N') {
+            if (p->num >= 0 && p->num <= 9 && p->num == (int)p->num && !std::signbit(p->num)) {
+                emitChar((char)('0' + (int)p->num));
+            }
+            else {
+                char buf[NUMBER_BUF_SIZE + 2];
+                buf[0] = '[';
+                int len = formatNumberExact(p->num, buf + 1, NUMBER_BUF_SIZE);
+                buf[len + 1] = ']';
+                emit(buf, (size_t)len + 2);
+            }
+            continue;
+        }
+        if (p->kind == 'V') {
+            if (isBareVarCode(p->ch)) emitWord(&p->ch, 1);
+            else {
+                string name = varNameFromCode(p->ch);
+                emitChar('[');
+                emit(name.data(), name.size());
+                emitChar(']');
+            }
+            continue;
+        }
+        if (expanded) {
+            // һԪԪ
+            if (p->kind == 'F') {
+                string fn = funcNameFromCode(p->ch);
+                emitWord(fn.data(), fn.size());
+            }
+            else emitChar(p->ch);
+            continue;
+        }
+        st.push_back({ p, true });
+        if (p->kind != 'F') st.push_back({ p->r, false });
+        st.push_back({ p->l, false });
+    }
+}
+
+// ׺ȫţԪд (A op B)һԪд fn(A)дɿɾȷԭʽ
+template <class Sink>
+inline void serializeInfix(Node* root, Sink& out) {
+    // ջԪأtag Ϊ 'n' ʱ nodeΪ ')' ʱţΪ 'o' ʱ " op "
+    struct Item { Node* node; char tag; char op; };
+    thread_local vector<Item> st;
+    st.clear();
+    st.push_back({ root, 'n', 0 });
+    while (!st.empty()) {
+        Item it = st.back();
+        st.pop_back();
+        if (it.tag == ')') { out.put(')'); continue; }
+        if (it.tag == 'o') {
+            char buf[3] = { ' ', it.op, ' ' };
+            out.write(buf, 3);
+            continue;
+        }
+        Node* p = it.node;
+        if (!p) continue;
+        if (p->kind == 'N') {
+            char buf[NUMBER_BUF_SIZE];
+            int len = formatNumberExact(p->num, buf, sizeof(buf));
+            out.write(buf, (size_t)len);
+            continue;
+        }
+        if (p->kind == 'V') {
+            if (isBareVarCode(p->ch)) out.put(p->ch);
+            else {
+                string name = varNameFromCode(p->ch);
+                out.write(name.data(), name.size());
+            }
+            continue;
+        }
+
+        // һԪfn(ʽ)
+        if (p->kind == 'F') {
+            string fn = funcNameFromCode(p->ch);
+            out.write(fn.data(), fn.size());
+            out.put('(');
+            st.push_back({ nullptr, ')', 0 });
+            st.push_back({ p->l, 'n', 0 });
+            continue;
+        }
+
+        // Ԫ㣺(A op B)
+        out.put('(');
+        st.push_back({ nullptr, ')', 0 });
+        st.push_back({ p->r, 'n', 0 });
+        st.push_back({ nullptr, 'o', p->ch });
+        st.push_back({ p->l, 'n', 0 });
+    }
+}
+
 // ===================== ڵ㴴ߺ =====================
 
 // ֽڵ
 inline Node* makeNum(double v) {
-    Node* p = new Node();
+    Node* p = allocNode();
     p->kind = 'N';
     p->num = v;
     return p;
@@ -74,7 +570,7 @@ inline Node* makeNum(double v) {
 
 // ڵ
 inline Node* makeVar(char c) {
-    Node* p = new Node();
+    Node* p = allocNode();
     p->kind = 'V';
     p->ch = c;
     return p;
@@ -82,7 +578,7 @@ inline Node* makeVar(char c) {
 
 // ڵ
 inline Node* makeOp(char op, Node* L, Node* R) {
-    Node* p = new Node();
+    Node* p = allocNode();
     p->kind = 'O';
     p->ch = op;
     p->l = L;
@@ -92,7 +588,7 @@ inline Node* makeOp(char op, Node* L, Node* R) {
 
 // һԪڵ㣨sin/cos/tan/ln
 inline Node* makeFunc(const std::string& name, Node* child) {
-    Node* p = new Node();
+    Node* p = allocNode();
     p->kind = 'F';
     p->ch = funcCodeFromName(name);
     p->l = child;
@@ -113,140 +609,610 @@ inline bool isNumLeaf(Node* p, double& v) {
     return true;
 }
 
+// ڵĹ۵makeOpFold  ppe_dag.h  dagOpFold ͬһж
+enum OpFold {
+    FOLD_NONE,    // ۵ճڵ
+    FOLD_LEFT,    // 
+    FOLD_RIGHT,   // Ҳ
+    FOLD_CONST,   // Ϊ value
+};
+
+// ж L op R ܷڹʱ۵߶ǳʱֱӼ㣻x+00+xx-0x*00*xx*11*x0/xx/1x^0x^1
+inline OpFold opFoldDecision(char op, Node* L, Node* R, double& value) {
+    double lv = 0, rv = 0;
+    bool lConst = isNumLeaf(L, lv);
+    bool rConst = isNumLeaf(R, rv);
+    bool lZero = lConst && std::fabs(lv) < 1e-12, rZero = rConst && std::fabs(rv) < 1e-12;
+    bool lOne = lConst && std::fabs(lv - 1) < 1e-12, rOne = rConst && std::fabs(rv - 1) < 1e-12;
+
+    if (lConst && rConst) {
+        switch (op) {
+        case '+': value = lv + rv; return FOLD_CONST;
+        case '-': value = lv - rv; return FOLD_CONST;
+        case '*': value = lv * rv; return FOLD_CONST;
+        case '/': if (std::fabs(rv) >= 1e-12) { value = lv / rv; return FOLD_CONST; } break;
+        case '^': value = std::pow(lv, rv); return FOLD_CONST;
+        default: break;
+        }
+    }
+    switch (op) {
+    case '+':
+        if (rZero) return FOLD_LEFT;
+        if (lZero) return FOLD_RIGHT;
+        break;
+    case '-':
+        if (rZero) return FOLD_LEFT;
+        break;
+    case '*':
+        if (lZero || rZero) { value = 0; return FOLD_CONST; }
+        if (rOne) return FOLD_LEFT;
+        if (lOne) return FOLD_RIGHT;
+        break;
+    case '/':
+        if (lZero && !rZero) { value = 0; return FOLD_CONST; }
+        if (rOne) return FOLD_LEFT;
+        break;
+    case '^':
+        if (rZero) { value = 1; return FOLD_CONST; }
+        if (rOne) return FOLD_LEFT;
+        break;
+    default:
+        break;
+    }
+    return FOLD_NONE;
+}
+
+// ڵ㣬ʱ opFoldDecision ۵ãʹһɾͲ *0*1+0
+// ȡ LR Ȩһͷ
+inline Node* makeOpFold(char op, Node* L, Node* R) {
+    double v = 0;
+    switch (opFoldDecision(op, L, R, v)) {
+    case FOLD_LEFT: freeTree(R); return L;
+    case FOLD_RIGHT: freeTree(L); return R;
+    case FOLD_CONST: freeTree(L); freeTree(R); return makeNum(v);
+    default: return makeOp(op, L, R);
+    }
+}
+
 // ǰʽ
 inline Node* simplifyNode(Node* p);
 
+// ===================== лά =====================
+
+// ¼ÿں׺׺еƬγȣԼڵĸڵ
+// ƬһΣһԪĲƬεɸڵƬεƳ
+// ƬνڸڵƬεһַ׺Ϊ׺Ϊţ֮ǰֻǳȣ
+// ܴӸھɴеλ
+// ֲ޸ĺֻӸ޸Ĵ·Ӿɴθ
+class SerialIndex {
+public:
+    static const size_t NONE = (size_t)-1;
+
+    bool valid() const { return ok; }
+
+    void invalidate() {
+        ok = false;
+        spans.clear();
+    }
+
+    // ͷɺ׺/׺ͬʱ¼Ƭγ
+    void rebuild(Node* root, string& post, string& in) {
+        spans.clear();
+        string p, i;
+        postfixPass(root, string(), p, nullptr, nullptr, 0);
+        infixPass(root, string(), i, nullptr, nullptr, 0);
+        post.swap(p);
+        in.swap(i);
+        ok = true;
+    }
+
+    // ظڵӸ target ·ˣtarget ʱ false
+    bool pathTo(Node* root, Node* target, vector<Node*>& path) const {
+        path.clear();
+        for (Node* p = target; p; ) {
+            auto it = spans.find(p);
+            if (it == spans.end()) { path.clear(); return false; }
+            path.push_back(p);
+            p = it->second.parent;
+        }
+        if (path.empty() || path.back() != root) { path.clear(); return false; }
+        std::reverse(path.begin(), path.end());
+        return true;
+    }
+
+    //  pathӸĳڵ㣩ĩ˽ڵƬڵǰе
+    bool locate(const vector<Node*>& path, size_t& postOff, size_t& inOff) const {
+        postOff = inOff = 0;
+        for (size_t k = 0; k + 1 < path.size(); ++k) {
+            Node* q = path[k];
+            Node* c = path[k + 1];
+            auto iq = spans.find(q);
+            auto ic = spans.find(c);
+            if (iq == spans.end() || ic == spans.end()) return false;
+            if (c == q->l) {
+                inOff += (q->kind == 'F') ? funcNameFromCode(q->ch).size() + 1 : 1;
+            }
+            else {
+                postOff += iq->second.postLen - 1 - ic->second.postLen;
+                inOff += iq->second.inLen - 1 - ic->second.inLen;
+            }
+        }
+        return true;
+    }
+
+    // ɾһļ¼Ƴڵ½ģ
+    void forget(Node* root) {
+        vector<Node*> st;
+        if (root) st.push_back(root);
+        while (!st.empty()) {
+            Node* p = st.back();
+            st.pop_back();
+            spans.erase(p);
+            if (p->l) st.push_back(p->l);
+            if (p->r) st.push_back(p->r);
+        }
+    }
+    void forgetNode(Node* p) { spans.erase(p); }
+
+    // ڵ㱻ͬݵĸȡ·ƣ¼ĵ£ڵΪ parent
+    void moveNode(Node* from, Node* to, Node* parent) {
+        auto it = spans.find(from);
+        if (it == spans.end()) return;
+        Span s = it->second;
+        s.parent = parent;
+        spans.erase(it);
+        spans[to] = s;
+    }
+
+    // д p ¼ĸڵ
+    void setParent(Node* p, Node* parent) {
+        auto it = spans.find(p);
+        if (it != spans.end()) it->second.parent = parent;
+    }
+
+    // ֲ޸ĺ
+    // changedӽڵ㱻Ľڵ㣨Ӹ޸Ĵڵ·½еĽڵ forget
+    // keep/keepPost/keepInԭľƬھɴе㣨ûʱ keep Ϊգ
+    void update(Node* root, const vector<Node*>& changed, Node* keep, size_t keepPost, size_t keepIn,
+        string& post, string& in) {
+        std::unordered_set<const Node*> dirty(changed.begin(), changed.end());
+        string p, i;
+        p.reserve(post.size() + 16);
+        i.reserve(in.size() + 16);
+        postfixPass(root, post, p, &dirty, keep, keepPost);
+        infixPass(root, in, i, &dirty, keep, keepIn);
+        post.swap(p);
+        in.swap(i);
+    }
+
+private:
+    struct Span {
+        size_t postLen = NONE;   // ׺ƬγȣƬǰķָո
+        size_t inLen = NONE;     // ׺Ƭγ
+        Node* parent = nullptr;
+    };
+
+    struct Frame {
+        Node* p;
+        Node* parent;
+        size_t oldOff;   // Ƭھɴе㣬δ֪Ϊ NONE
+        size_t rOff;     // Ƭھɴе
+        size_t start;    // Ƭ´е
+        int stage;       // 0 δʼ1 2 
+    };
+
+    // ֻĩβСдĸӰĵǰǷ񲹿ոַһΪ 0
+    static void normTail(char& t0, char& t1) {
+        auto lower = [](char c) { return c >= 'a' && c <= 'z'; };
+        if (!lower(t1)) t0 = t1 = 0;
+        else if (!lower(t0)) t0 = 0;
+    }
+
+    static void tailOf(const string& s, size_t end, char& t0, char& t1) {
+        t0 = end >= 2 ? s[end - 2] : 0;
+        t1 = end >= 1 ? s[end - 1] : 0;
+    }
+
+    static void postfixWord(string& out, const char* w, size_t len) {
+        char t0, t1;
+        tailOf(out, out.size(), t0, t1);
+        if (postfixNeedsSpace(t0, t1, w, len)) out += ' ';
+        out.append(w, len);
+    }
+
+    // ɴ old  o ĺ׺ƬΣǰĩβָո֮ɴڸôȼʱֱͬӸ
+    static bool copyPostfix(const string& old, size_t o, size_t len, string& out) {
+        char w = old[o];
+        char t0, t1;
+        tailOf(out, out.size(), t0, t1);
+        bool sep = (w >= 'a' && w <= 'z') && postfixNeedsSpace(t0, t1, &w, 1);
+        if (sep) { t0 = t1; t1 = ' '; }
+        char o0, o1;
+        tailOf(old, o, o0, o1);
+        normTail(t0, t1);
+        normTail(o0, o1);
+        if (t0 != o0 || t1 != o1) return false;
+        if (sep) out += ' ';
+        out.append(old, o, len);
+        return true;
+    }
+
+    // ֪λáм¼Ҳ޸·ϵԸ
+    Span* reusable(Node* p, size_t oldOff, const std::unordered_set<const Node*>* dirty, bool post) {
+        if (oldOff == NONE) return nullptr;
+        auto it = spans.find(p);
+        if (it == spans.end() || (post ? it->second.postLen : it->second.inLen) == NONE) return nullptr;
+        if (dirty && dirty->count(p)) return nullptr;
+        return &it->second;
+    }
+
+    // оɼ¼Ľڵ㣨޸·ϵĽڵ㣩ɾɼ¼Ƴھɴеλ
+    const Span* oldSpan(Node* p, size_t oldOff, bool post) const {
+        if (oldOff == NONE || !p) return nullptr;
+        auto it = spans.find(p);
+        if (it == spans.end() || (post ? it->second.postLen : it->second.inLen) == NONE) return nullptr;
+        return &it->second;
+    }
+
+    void postfixPass(Node* root, const string& old, string& out,
+        const std::unordered_set<const Node*>* dirty, Node* keep, size_t keepOff) {
+        vector<Frame> st;
+        st.push_back({ root, nullptr, old.empty() ? NONE : 0, NONE, 0, 0 });
+        while (!st.empty()) {
+            Frame& f = st.back();
+            Node* p = f.p;
+            if (!p) { st.pop_back(); continue; }
+
+            if (f.stage == 0) {
+                Span* s = reusable(p, f.oldOff, dirty, true);
+                if (s && copyPostfix(old, f.oldOff, s->postLen, out)) {
+                    s->parent = f.parent;   // Ƶܻ˸ڵ㣨类µĺڵ㣩
+                    st.pop_back();
+                    continue;
+                }
+
+                f.start = out.size();
+                if (p->kind == 'N' || p->kind == 'V') {
+                    StringSink sink(out);
+                    if (p->kind == 'V' && isBareVarCode(p->ch)) postfixWord(out, &p->ch, 1);
+                    else serializePostfix(p, sink);   // ֺ [name] СдĸͷǰӰ
+                    finishPost(p, f.parent, f.start, out);
+                    st.pop_back();
+                    continue;
+                }
+
+                size_t lOff = NONE, rOff = NONE;
+                const Span* ps = oldSpan(p, f.oldOff, true);
+                if (ps) {
+                    lOff = f.oldOff;
+                    const Span* rs = (p->kind != 'F') ? oldSpan(p->r, f.oldOff, true) : nullptr;
+                    if (rs) rOff = f.oldOff + ps->postLen - 1 - rs->postLen;
+                }
+                if (keep && p->l == keep) lOff = keepOff;
+                if (keep && p->r == keep) rOff = keepOff;
+                f.rOff = rOff;
+                f.stage = 1;
+                st.push_back({ p->l, p, lOff, NONE, 0, 0 });
+                continue;
+            }
+
+            if (f.stage == 1 && p->kind != 'F') {
+                f.stage = 2;
+                size_t rOff = f.rOff;
+                st.push_back({ p->r, p, rOff, NONE, 0, 0 });
+                continue;
+            }
+
+            if (p->kind == 'F') {
+                string fn = funcNameFromCode(p->ch);
+                postfixWord(out, fn.data(), fn.size());
+            }
+            else out += p->ch;
+            finishPost(p, f.parent, f.start, out);
+            st.pop_back();
+        }
+    }
+
+    void infixPass(Node* root, const string& old, string& out,
+        const std::unordered_set<const Node*>* dirty, Node* keep, size_t keepOff) {
+        vector<Frame> st;
+        st.push_back({ root, nullptr, old.empty() ? NONE : 0, NONE, 0, 0 });
+        while (!st.empty()) {
+            Frame& f = st.back();
+            Node* p = f.p;
+            if (!p) { st.pop_back(); continue; }
+
+            if (f.stage == 0) {
+                const Span* s = reusable(p, f.oldOff, dirty, false);
+                if (s) {
+                    out.append(old, f.oldOff, s->inLen);
+                    st.pop_back();
+                    continue;
+                }
+
+                f.start = out.size();
+                if (p->kind == 'N' || p->kind == 'V') {
+                    StringSink sink(out);
+                    serializeInfix(p, sink);
+                    finishIn(p, f.start, out);
+                    st.pop_back();
+                    continue;
+                }
+
+                size_t lOff = NONE, rOff = NONE;
+                const Span* ps = oldSpan(p, f.oldOff, false);
+                if (p->kind == 'F') {
+                    string fn = funcNameFromCode(p->ch);
+                    out += fn;
+                    out += '(';
+                    if (ps) lOff = f.oldOff + fn.size() + 1;
+                }
+                else {
+                    out += '(';
+                    if (ps) {
+                        lOff = f.oldOff + 1;
+                        const Span* rs = oldSpan(p->r, f.oldOff, false);
+                        if (rs) rOff = f.oldOff + ps->inLen - 1 - rs->inLen;
+                    }
+                }
+                if (keep && p->l == keep) lOff = keepOff;
+                if (keep && p->r == keep) rOff = keepOff;
+                f.rOff = rOff;
+                f.stage = 1;
+                st.push_back({ p->l, p, lOff, NONE, 0, 0 });
+                continue;
+            }
+
+            if (f.stage == 1 && p->kind != 'F') {
+                out += ' ';
+                out += p->ch;
+                out += ' ';
+                f.stage = 2;
+                size_t rOff = f.rOff;
+                st.push_back({ p->r, p, rOff, NONE, 0, 0 });
+                continue;
+            }
+
+            out += ')';
+            finishIn(p, f.start, out);
+            st.pop_back();
+        }
+    }
+
+    void finishPost(Node* p, Node* parent, size_t start, const string& out) {
+        size_t len = out.size() - start;
+        if (len && out[start] == ' ') --len;   // Ƭǰķָո񲻼Ƭ
+        Span& s = spans[p];
+        s.postLen = len;   // ½ڵ inLen  NONE׺һд
+        s.parent = parent;
+    }
+
+    void finishIn(Node* p, size_t start, const string& out) {
+        spans[p].inLen = out.size() - start;
+    }
+
+    std::unordered_map<const Node*, Span> spans;
+    bool ok = false;
+};
+
 // ===================== ʽ =====================
 struct ExprTree {
 	Node* root = nullptr; // ڵ
 	string postfixRaw;  // ׺ʽַ
     string infixCache;  // ׺ʽ
+    std::shared_ptr<NodeArena> arena;  // ڵڴأ ExprTree ʱһ߸գ
+    SerialIndex serial;  // 洮иƬε״ξֲ޸ʱ
 
-    // ձʽ
-    void clear() {
+    // ȡҪʱĽڵڴ
+    NodeArena* ensureArena() {
+        if (!arena) arena = std::make_shared<NodeArena>();
+        return arena.get();
+    }
+
+    // ͷȫڵ㣺ռ arena ʱһ resetʱֻ
+    void releaseNodes() {
         freeTree(root);
         root = nullptr;
+        serial.invalidate();
+        if (arena) {
+            if (arena.use_count() == 1) arena->reset();
+            else arena.reset();
+        }
+    }
+
+    // ձʽ
+    void clear() {
+        releaseNodes();
 		postfixRaw.clear();  // պ׺ʽ
         infixCache.clear();  // ׺
     }
+
+    // ӹһĸڵ㡢ڴغͻ棨other ÿգͷŽڵ㣩
+    void takeFrom(ExprTree& other) {
+        if (this == &other) return;
+        releaseNodes();
+        root = other.root;
+        arena = std::move(other.arena);
+        postfixRaw = std::move(other.postfixRaw);
+        infixCache = std::move(other.infixCache);
+        serial = std::move(other.serial);
+        other.serial.invalidate();
+        other.root = nullptr;
+        other.arena.reset();
+        other.postfixRaw.clear();
+        other.infixCache.clear();
+    }
     // ɺ׺ʽ
     string toPostfix() const {
-		string result;  // ׺ʽ
-        std::function<void(Node*)> dfs = [&](Node* p) {
-            if (!p) return;
-            if (p->kind == 'N') {
-                // ֣򲻴С
-                if (p->num == (int)p->num && p->num >= 0 && p->num <= 9) {
-                    result += (char)('0' + (int)p->num);
-                }
-                else {
-					std::ostringstream oss; // λű
-					oss << p->num;          // תΪַ
-                    result += "[" + oss.str() + "]";  // űǶλ
-                }
-                return;
-            }
-            if (p->kind == 'V') {
-                result += p->ch;
-                return;
-            }
-            if (p->kind == 'F') {
-                dfs(p->l);
-                result += funcNameFromCode(p->ch);  // 
-                return;
-            }
-            // Ԫ  
-            dfs(p->l);
-            dfs(p->r);
-            result += p->ch;
-            };
-        dfs(root);
+        string result;
+        result.reserve(treeNodeCount(root) * 2);  // ǺΪһַ
+        appendPostfix(result);
         return result;
     }
 
-    // º׺׺
+    // Ѻ׺ʽ׷ӵ÷ṩĻ
+    void appendPostfix(string& out) const {
+        StringSink sink(out);
+        serializePostfix(root, sink);
+    }
+
+    // Ѻ׺ʽд
+    void writePostfix(std::ostream& os) const {
+        StreamSink sink(os);
+        serializePostfix(root, sink);
+    }
+
+    // º׺׺棨ֱӸĶڵãֲ޸ wrapSubtree/replaceSubtree
     void updateCaches() {
+        serial.invalidate();
         postfixRaw = toPostfix();
         infixCache = toInfix();
     }
     // Ӻ׺ʽַʽ
     bool buildFromPostfixChars(const string& s, string* err) {
+        return buildFromPostfix(s.data(), s.size(), err);
+    }
+
+    // Ӻ׺ʽʽɨ裬ֱڽڵջϽмǺű
+    // Ǻţ
+    //   0-9              һλ֣ԭд"23+" ʾ 2 + 3
+    //   a-z              ĸ
+    //   [3.14] [-2e-5]   toPostfix ĸʽ
+    //   [x1] [rate]      ַĸ»߿ͷɺ
+    //   sin cos tan ln   һԪĸƴʱͬĵĸʱÿո
+    //   + - * / ^        Ԫ
+    bool buildFromPostfix(const char* s, size_t n, string* err) {
+        bool ok = parsePostfix(s, n, err);
+        postfixRaw.assign(s, n);
+        if (ok) infixCache = toInfix();  // Զ׺ʽ
+        return ok;
+    }
+
+    // ֻɺ׺/׺棨ʽʱʹã
+    // ڵջ̸߳ã arena  clear() ҲḴã¼ʱٷڴ
+    bool parsePostfix(const char* s, size_t n, string* err) {
         clear();
-        postfixRaw = s;
+        NodeArenaScope scope(ensureArena());  // нڵ䵽 arena
 
-		vector<Node*> st;   // ջ
+        thread_local vector<Node*> st;   // ջ
+        st.clear();
+        auto fail = [&](const string& msg) {
+            if (err) *err = msg;
+            for (auto* x : st) freeTree(x);
+            st.clear();
+            return false;
+        };
 
-        for (char c : s) {
+        for (size_t i = 0; i < n; ++i) {
+            char c = s[i];
             if (c == ' ' || c == '\t' || c == '\r' || c == '\n') continue;
             if (c >= '0' && c <= '9') {
-                Node* p = new Node();
+                Node* p = allocNode();
                 p->kind = 'N';
                 p->num = (double)(c - '0');
                 st.push_back(p);
             }
             else if (c >= 'a' && c <= 'z') {
-                Node* p = new Node();
-                p->kind = 'V';
-                p->ch = c;
+                char code = 0;
+                size_t len = matchFuncName(s, n, i, code);
+                if (len) {
+                    // һԪһ
+                    if (st.empty()) return fail("㣬ʽϷ");
+                    Node* p = allocNode();
+                    p->kind = 'F';
+                    p->ch = code;
+                    p->l = st.back();
+                    st.back() = p;
+                    i += len - 1;
+                }
+                else {
+                    Node* p = allocNode();
+                    p->kind = 'V';
+                    p->ch = c;
+                    st.push_back(p);
+                }
+            }
+            else if (c == '[') {
+                // żǺţַ
+                const char* q = (const char*)std::memchr(s + i + 1, ']', n - i - 1);
+                if (!q) return fail("ȱ ]");
+                const char* b = s + i + 1;
+                const char* e = q;
+                while (b < e && (*b == ' ' || *b == '\t')) ++b;
+                while (e > b && (e[-1] == ' ' || e[-1] == '\t')) --e;
+                size_t len = (size_t)(e - b);
+                if (len == 0) return fail("յ [] Ǻ");
+
+                char small[64];
+                string big;
+                char* text = small;
+                if (len >= sizeof(small)) {
+                    big.assign(b, len);
+                    text = &big[0];
+                }
+                else {
+                    std::memcpy(small, b, len);
+                    small[len] = 0;
+                }
+
+                char* end = nullptr;
+                double v = std::strtod(text, &end);
+                Node* p = allocNode();
+                if (end == text + len) {
+                    p->kind = 'N';
+                    p->num = v;
+                }
+                else if (isIdentifier(b, len)) {
+                    char code = varCodeFromName(b, len);
+                    if (!code) return fail("ַࣨһֱ 128 ");
+                    p->kind = 'V';
+                    p->ch = code;
+                }
+                else {
+                    return fail("ǷǺţ[" + string(b, len) + "]");
+                }
                 st.push_back(p);
+                i = (size_t)(q - s);
             }
             else if (isOp(c)) {
-                if ((int)st.size() < 2) {
-                    if (err) *err = "㣬ʽϷ";
-                    for (auto* x : st) freeTree(x);
-                    st.clear();
-                    return false;
-                }
+                if ((int)st.size() < 2) return fail("㣬ʽϷ");
                 Node* b = st.back(); st.pop_back();
                 Node* a = st.back(); st.pop_back();
-                Node* p = new Node();
+                Node* p = allocNode();
                 p->kind = 'O';
                 p->ch = c;
                 p->l = a; p->r = b;
                 st.push_back(p);
             }
             else {
-                if (err) *err = string("Ƿַ") + c;
-                for (auto* x : st) freeTree(x);
-                st.clear();
-                return false;
+                return fail(string("Ƿַ") + c);
             }
         }
 
-        if (st.size() != 1) {
-            if (err) *err = "ʽϷջԪزΪ1";
-            for (auto* x : st) freeTree(x);
-            st.clear();
-            return false;
-        }
+        if (st.size() != 1) return fail("ʽϷջԪزΪ1");
         root = st.back();
-        infixCache = toInfix();  // Զ׺ʽ
+        st.clear();
         return true;
     }
 
     // ׺ȫţ֧к
     string toInfix() const {
-        std::function<string(Node*)> dfs = [&](Node* p)->string {
-            if (!p) return "";
-            if (p->kind == 'N') {
-                std::ostringstream oss;
-                oss << p->num;
-                return oss.str();
-            }
-            if (p->kind == 'V') return string(1, p->ch);
+        string result;
+        result.reserve(treeNodeCount(root) * 4);  // ÿԪԼ 5 ַ"(" " op " ")"
+        appendInfix(result);
+        return result;
+    }
 
-            // һԪ
-            if (p->kind == 'F') {
-                string fn = funcNameFromCode(p->ch);
-                return fn + "(" + dfs(p->l) + ")";
-            }
+    // ׺ʽ׷ӵ÷ṩĻ
+    void appendInfix(string& out) const {
+        StringSink sink(out);
+        serializeInfix(root, sink);
+    }
 
-            // Ԫ
-            string A = dfs(p->l);
-            string B = dfs(p->r);
-            return "(" + A + " " + string(1, p->ch) + " " + B + ")";
-            };
-        return dfs(root);
+    // ׺ʽд
+    void writeInfix(std::ostream& os) const {
+        StreamSink sink(os);
+        serializeInfix(root, sink);
     }
 
     // ׺
@@ -257,48 +1223,65 @@ struct ExprTree {
     // ռʽб
     std::set<char> collectVars() const {
         std::set<char> S;
-        std::function<void(Node*)> dfs = [&](Node* p) {
-            if (!p) return;
+        vector<Node*> st;
+        if (root) st.push_back(root);
+        while (!st.empty()) {
+            Node* p = st.back();
+            st.pop_back();
             if (p->kind == 'V') S.insert(p->ch);
-            dfs(p->l); dfs(p->r);
-            };
-        dfs(root);
+            if (p->l) st.push_back(p->l);
+            if (p->r) st.push_back(p->r);
+        }
         return S;
     }
 
     // ʽֵ֧ sin/cos/tan/ln
+    //  + ֵջңݺȺ˳ݹֵͬ
     bool eval(const std::map<char, double>& vars, double& out, string* err) const {
-        std::function<bool(Node*, double&)> dfs = [&](Node* p, double& v)->bool {
+        vector<std::pair<Node*, bool>> st;  // (ڵ, ӽڵǷֵ)
+        vector<double> vals;
+        st.push_back({ root, false });
+
+        while (!st.empty()) {
+            Node* p = st.back().first;
+            bool expanded = st.back().second;
+            st.pop_back();
+
             if (!p) { if (err) *err = "սڵ"; return false; }
 
-            if (p->kind == 'N') { v = p->num; return true; }
+            if (p->kind == 'N') { vals.push_back(p->num); continue; }
 
             if (p->kind == 'V') {
                 auto it = vars.find(p->ch);
                 if (it == vars.end()) {
-                    if (err) *err = string("δֵ: ") + p->ch;
+                    if (err) *err = "δֵ: " + varNameFromCode(p->ch);
                     return false;
                 }
-                v = it->second;
-                return true;
+                vals.push_back(it->second);
+                continue;
+            }
+
+            if (!expanded) {
+                st.push_back({ p, true });
+                if (p->kind != 'F') st.push_back({ p->r, false });
+                st.push_back({ p->l, false });
+                continue;
             }
 
             // һԪ֧ sin/cos/tan/ln
             if (p->kind == 'F') {
-                double x = 0;
-                if (!dfs(p->l, x)) return false;
-
+                double& x = vals.back();
                 switch (p->ch) {
-                case 's': v = std::sin(x); return true;
-                case 'c': v = std::cos(x); return true;
-                case 't': v = std::tan(x); return true;
+                case 's': x = std::sin(x); continue;
+                case 'c': x = std::cos(x); continue;
+                case 't': x = std::tan(x); continue;
                 case 'l':
                     if (x <= 0) {
                         if (err) *err = "ln  > 0";
                         return false;
                     }
-                    v = std::log(x);
-                    return true;
+                    x = std::log(x);
+                    continue;
                 default:
                     if (err) *err = "δ֪ڵ";
                     return false;
@@ -306,31 +1289,33 @@ struct ExprTree {
             }
 
             // Ԫ
-            double x = 0, y = 0;
-            if (!dfs(p->l, x)) return false;
-            if (!dfs(p->r, y)) return false;
+            double y = vals.back();
+            vals.pop_back();
+            double& x = vals.back();
 
             switch (p->ch) {
-            case '+': v = x + y; return true;
-            case '-': v = x - y; return true;
-            case '*': v = x * y; return true;
+            case '+': x = x + y; break;
+            case '-': x = x - y; break;
+            case '*': x = x * y; break;
             case '/':
                 if (std::fabs(y) < 1e-12) { if (err) *err = ""; return false; }
-                v = x / y; return true;
+                x = x / y; break;
             case '^':
-                v = std::pow(x, y); return true;
+                x = std::pow(x, y); break;
             default:
                 if (err) *err = string("δ֪: ") + p->ch;
                 return false;
             }
-            };
+        }
 
-        return dfs(root, out);
+        out = vals.back();
+        return true;
     }
 
     // 
     ExprTree clone() const {
         ExprTree T;
+        NodeArenaScope scope(T.ensureArena());
         T.root = cloneTree(root);
         T.postfixRaw = postfixRaw;
         T.infixCache = infixCache;  // ͬʱ׺
@@ -339,9 +1324,97 @@ struct ExprTree {
 
     // ʽ
     void simplify() {
+        NodeArenaScope scope(ensureArena());  // ½Ľڵ䵽 arena
         root = simplifyNode(root);
         updateCaches();  // ͬʱ׺ͺ׺
     }
+
+    // ---------- ֲ޸ģ洮ֻ޸Ĵ·ಿִӾɴ ----------
+    // һξֲ޸ʱͷһpostfixRaw Ϊ淶ʽ
+
+    //  target һԪ fn(target)fn Ϊ루s/c/t/l
+    bool wrapSubtree(Node* target, char fn) {
+        vector<Node*> path;
+        size_t postOff, inOff;
+        if (!beginEdit(target, path, postOff, inOff)) return false;
+        Node* f;
+        {
+            // arena ڵ֮²ܹҶѽڵ㣨freeTree  arena ڵ㼴ֹͣtarget ڶʱ½ڵҲڶ
+            NodeArenaScope scope(target->inArena ? ensureArena() : nullptr);
+            f = allocNode();
+        }
+        f->kind = 'F';
+        f->ch = fn;
+        f->l = target;
+        attach(path, f);
+        serial.forgetNode(f);
+        path.pop_back();  // ӽڵ㱻ֻ target 
+        serial.update(root, path, target, postOff, inOff, postfixRaw, infixCache);
+        return true;
+    }
+
+    // ·ƣѸ target ڵ·ϵĽڵ㻻ɸtarget ·ԭ
+    // ɽڵ˺ٱĶǵľɰ汾糷գԭ޸ĵӰ죻
+    // copies ǿʱμ¼ɽڵ, ֻȸļǵ
+    // Ľڵ㲻ܵͷţֻȫڵ㶼 arena е򷵻 false
+    bool copyPath(Node* target, vector<std::pair<const Node*, Node*>>* copies = nullptr) {
+        if (copies) copies->clear();
+        if (!root || !target || !root->inArena) return false;
+        if (!serial.valid()) serial.rebuild(root, postfixRaw, infixCache);
+        vector<Node*> path;
+        if (!serial.pathTo(root, target, path)) return false;
+
+        NodeArenaScope scope(ensureArena());
+        Node* prev = nullptr;
+        for (size_t k = 0; k + 1 < path.size(); ++k) {
+            Node* old = path[k];
+            Node* c = allocNode();
+            c->kind = old->kind;
+            c->ch = old->ch;
+            c->num = old->num;
+            c->l = old->l;
+            c->r = old->r;
+            if (!prev) root = c;
+            else if (prev->l == old) prev->l = c;
+            else prev->r = c;
+            serial.moveNode(old, c, prev);
+            if (c->l) serial.setParent(c->l, c);
+            if (c->r) serial.setParent(c->r, c);
+            if (copies) copies->push_back({ old, c });
+            prev = c;
+        }
+        return true;
+    }
+
+    //  repl 滻 target ͷ target repl еĽڵΪ½ڵ
+    bool replaceSubtree(Node* target, Node* repl) {
+        vector<Node*> path;
+        size_t postOff, inOff;
+        if (!repl || !beginEdit(target, path, postOff, inOff)) return false;
+        attach(path, repl);
+        serial.forget(target);
+        freeTree(target);
+        serial.forget(repl);
+        path.pop_back();
+        serial.update(root, path, nullptr, 0, 0, postfixRaw, infixCache);
+        return true;
+    }
+
+private:
+    // ҵ target ·еλãЧʱȴͷ
+    bool beginEdit(Node* target, vector<Node*>& path, size_t& postOff, size_t& inOff) {
+        if (!root || !target) return false;
+        if (!serial.valid()) serial.rebuild(root, postfixRaw, infixCache);
+        return serial.pathTo(root, target, path) && serial.locate(path, postOff, inOff);
+    }
+
+    //  path ĩ˵ sub
+    void attach(const vector<Node*>& path, Node* sub) {
+        if (path.size() == 1) { root = sub; return; }
+        Node* parent = path[path.size() - 2];
+        if (parent->l == path.back()) parent->l = sub;
+        else parent->r = sub;
+    }
 };
 
 // ===================== ϱʽ =====================
@@ -352,151 +1425,214 @@ inline ExprTree Compose(const ExprTree& E1, const ExprTree& E2, char op, string*
     if (!isOp(op)) { if (err) *err = "P ǺϷԪ"; return R; }
     if (!E1.root || !E2.root) { if (err) *err = "E1  E2 Ϊ"; return R; }
 
-    Node* p = new Node();
+    NodeArenaScope scope(R.ensureArena());
+    Node* p = allocNode();
     p->kind = 'O'; p->ch = op;
     p->l = cloneTree(E1.root);
     p->r = cloneTree(E2.root);
     R.root = p;
-    R.postfixRaw = E1.postfixRaw + E2.postfixRaw + op;
+
+    //  E1E2 Ļƴӣ
+    // ׺ E1 ĸβE2 ĸͷʱӿոߵĸƴɺ
+    R.postfixRaw = E1.postfixRaw;
+    auto lower = [](char c) { return c >= 'a' && c <= 'z'; };
+    if (!E1.postfixRaw.empty() && !E2.postfixRaw.empty() &&
+        lower(E1.postfixRaw.back()) && lower(E2.postfixRaw.front())) R.postfixRaw += ' ';
+    R.postfixRaw += E2.postfixRaw;
+    R.postfixRaw += op;
+    if (!E1.infixCache.empty() && !E2.infixCache.empty()) {
+        R.infixCache.reserve(E1.infixCache.size() + E2.infixCache.size() + 5);
+        R.infixCache += '(';
+        R.infixCache += E1.infixCache;
+        R.infixCache += ' ';
+        R.infixCache += op;
+        R.infixCache += ' ';
+        R.infixCache += E2.infixCache;
+        R.infixCache += ')';
+    }
+    else R.updateInfixCache();
     return R;
 }
 
 // ===================== ƫģ֧Ǻ/ln + ͨ㣩 =====================
 
-// Աʽƫڵ㣨ݹģ
-inline Node* derivNode(Node* p, char var, string* err) {
-    if (!p) return nullptr;
+// Աʽƫڵ
+// ӽڵĵѹջڵʱٰ󵼷
+inline Node* derivNode(Node* root, char var, string* err) {
+    vector<std::pair<Node*, bool>> st;  // (ڵ, ӽڵ㵼Ƿ)
+    vector<Node*> ds;                   // ĵ
+    st.push_back({ root, false });
 
-    //  = 0
-    if (p->kind == 'N') return makeNum(0);
+    while (!st.empty()) {
+        Node* p = st.back().first;
+        bool expanded = st.back().second;
+        st.pop_back();
 
-    // 󵼣Լ=1=0
-    if (p->kind == 'V') {
-        return makeNum(p->ch == var ? 1 : 0);
-    }
+        if (!p) { ds.push_back(nullptr); continue; }
 
-    // һԪʽ
-    if (p->kind == 'F') {
-        Node* u = p->l;
-        Node* du = derivNode(u, var, err);  
-        if (!du) return makeNum(0);
+        //  = 0
+        if (p->kind == 'N') { ds.push_back(makeNum(0)); continue; }
 
-        // sin(u)' = cos(u) * u'
-        if (p->ch == 's') {
-            return makeOp('*', makeFunc("cos", cloneTree(u)), du);
-        }
+        // 󵼣Լ=1=0
+        if (p->kind == 'V') { ds.push_back(makeNum(p->ch == var ? 1 : 0)); continue; }
 
-        // cos(u)' = -sin(u) * u'
-        if (p->ch == 'c') {
-            Node* negSin = makeOp('*', makeNum(-1), makeFunc("sin", cloneTree(u)));
-            return makeOp('*', negSin, du);
+        char op = p->ch;
+        if (!expanded) {
+            if (p->kind != 'F') {
+                // ȱӱʽδ֪ٶӽڵ
+                if (op == '^' && (!p->l || !p->r)) {
+                    if (err) *err = "ݽڵȱӱʽ";
+                    ds.push_back(makeNum(0));
+                    continue;
+                }
+                if (!isOp(op)) {
+                    if (err) *err = "δ֪޷";
+                    ds.push_back(nullptr);
+                    continue;
+                }
+            }
+            st.push_back({ p, true });
+            if (p->kind != 'F') st.push_back({ p->r, false });
+            st.push_back({ p->l, false });
+            continue;
         }
 
-        // tan(u)' = (1 / cos(u)^2) * u'
-        if (p->ch == 't') {
-            Node* c   = makeFunc("cos", cloneTree(u));
-            Node* c2  = makeOp('^', c, makeNum(2));
-            Node* inv = makeOp('/', makeNum(1), c2);
-            return makeOp('*', inv, du);
-        }
+        // һԪʽu' Ϊ 0 ʱΪ 0ٹ㵼
+        if (p->kind == 'F') {
+            Node* u = p->l;
+            Node* du = ds.back(); ds.pop_back();
+            double duv = 0;
+            if (!du) { ds.push_back(makeNum(0)); continue; }
+            if (isNumLeaf(du, duv) && std::fabs(duv) < 1e-12 && (op == 's' || op == 'c' || op == 't' || op == 'l')) {
+                ds.push_back(du);
+                continue;
+            }
 
-        // ln(u)' = u'/u
-        if (p->ch == 'l') {
-            return makeOp('/', du, cloneTree(u));
+            // sin(u)' = cos(u) * u'
+            if (op == 's') {
+                ds.push_back(makeOpFold('*', makeFunc("cos", cloneTree(u)), du));
+            }
+            // cos(u)' = -sin(u) * u'
+            else if (op == 'c') {
+                Node* negSin = makeOp('*', makeNum(-1), makeFunc("sin", cloneTree(u)));
+                ds.push_back(makeOpFold('*', negSin, du));
+            }
+            // tan(u)' = (1 / cos(u)^2) * u'
+            else if (op == 't') {
+                Node* c   = makeFunc("cos", cloneTree(u));
+                Node* c2  = makeOp('^', c, makeNum(2));
+                Node* inv = makeOp('/', makeNum(1), c2);
+                ds.push_back(makeOpFold('*', inv, du));
+            }
+            // ln(u)' = u'/u
+            else if (op == 'l') {
+                ds.push_back(makeOpFold('/', du, cloneTree(u)));
+            }
+            else {
+                if (err) *err = "ֵ֧ĺ";
+                freeTree(du);
+                ds.push_back(makeNum(0));
+            }
+            continue;
         }
 
-        if (err) *err = "ֵ֧ĺ";
-        return makeNum(0);
-    }
-
-    // 
-    char op = p->ch;
-
-    // (u + v)' = u' + v'    (u - v)' = u' - v'
-    if (op == '+' || op == '-') {
-        Node* dl = derivNode(p->l, var, err);
-        Node* dr = derivNode(p->r, var, err);
-        return makeOp(op, dl, dr);
-    }
-
-    // (u * v)' = u'*v + u*v'
-    if (op == '*') {
-        Node* du = derivNode(p->l, var, err);
-        Node* dv = derivNode(p->r, var, err);
-        Node* term1 = makeOp('*', du, cloneTree(p->r));
-        Node* term2 = makeOp('*', cloneTree(p->l), dv);
-        return makeOp('+', term1, term2);
-    }
-
-    // (u / v)' = (u'*v - u*v') / v^2
-    if (op == '/') {
-        Node* du = derivNode(p->l, var, err);
-        Node* dv = derivNode(p->r, var, err);
-        Node* nume1 = makeOp('*', du, cloneTree(p->r));
-        Node* nume2 = makeOp('*', cloneTree(p->l), dv);
-        Node* numerator = makeOp('-', nume1, nume2);
-        Node* denom = makeOp('^', cloneTree(p->r), makeNum(2));
-        return makeOp('/', numerator, denom);
-    }
-
-    // ͨ󵼣(u^v)' = u^v * (v' * ln(u) + v * u'/u)
-    // v ǳ => n * u^(n-1) * u'
-    if (op == '^') {
-        if (!p->l || !p->r) {
-            if (err) *err = "ݽڵȱӱʽ";
-            return makeNum(0);
+        // 󵼣ӽڵĵڽջ
+        //  makeOpFold ϣΪ 0 һ಻ٸƶӦ
+        Node* dr = ds.back(); ds.pop_back();
+        Node* dl = ds.back(); ds.pop_back();
+        double cv = 0;
+        bool dlZero = isNumLeaf(dl, cv) && std::fabs(cv) < 1e-12;
+        bool drZero = isNumLeaf(dr, cv) && std::fabs(cv) < 1e-12;
+
+        // (u + v)' = u' + v'    (u - v)' = u' - v'
+        if (op == '+' || op == '-') {
+            ds.push_back(makeOpFold(op, dl, dr));
         }
 
-        Node* u = p->l;
-        Node* v = p->r;
-
-        Node* du = derivNode(u, var, err);
-        Node* dv = derivNode(v, var, err);
-        if (!du || !dv) return makeNum(0);
+        // (u * v)' = u'*v + u*v'
+        else if (op == '*') {
+            Node* term1 = dlZero ? dl : makeOpFold('*', dl, cloneTree(p->r));
+            Node* term2 = drZero ? dr : makeOpFold('*', cloneTree(p->l), dr);
+            ds.push_back(makeOpFold('+', term1, term2));
+        }
 
-        // v ǳø n*u^(n-1)*u'
-        if (v->kind == 'N') {
-            double n = v->num;
+        // (u / v)' = (u'*v - u*v') / v^2 var ʱΪ u'/v
+        else if (op == '/') {
+            if (drZero) {
+                freeTree(dr);
+                ds.push_back(dlZero ? dl : makeOpFold('/', dl, cloneTree(p->r)));
+                continue;
+            }
+            Node* nume1 = dlZero ? dl : makeOpFold('*', dl, cloneTree(p->r));
+            Node* nume2 = makeOpFold('*', cloneTree(p->l), dr);
+            Node* numerator = makeOpFold('-', nume1, nume2);
+            Node* denom = makeOpFold('^', cloneTree(p->r), makeNum(2));
+            ds.push_back(makeOpFold('/', numerator, denom));
+        }
 
-            // ͷŲҪ dv
-            freeTree(dv);
+        // ͨ󵼣(u^v)' = u^v * (v' * ln(u) + v * u'/u)
+        // v ǳ => n * u^(n-1) * u'
+        else {
+            Node* u = p->l;
+            Node* v = p->r;
+            Node* du = dl;
+            Node* dv = dr;
 
-            if (std::fabs(n) < 1e-12) {
+            if (!du || !dv) {
                 freeTree(du);
-                return makeNum(0);   // u^0 = 1Ϊ 0
-            }
-            if (std::fabs(n - 1.0) < 1e-12) {
-                return du;           // u^1 = uΪ u'
+                freeTree(dv);
+                ds.push_back(makeNum(0));
             }
+            // v ǳø n*u^(n-1)*u'
+            else if (v->kind == 'N') {
+                double n = v->num;
 
-            Node* coef  = makeNum(n);
-            Node* power = makeOp('^', cloneTree(u), makeNum(n - 1.0));
-            return makeOp('*', makeOp('*', coef, power), du);
-        }
-
-        // ͨu^v * ( v' * ln(u) + v * (u'/u) )
-        Node* ln_u = makeFunc("ln", cloneTree(u));
-        Node* term1 = makeOp('*', dv, ln_u);
+                // ͷŲҪ dv
+                freeTree(dv);
 
-        Node* u_div = makeOp('/', du, cloneTree(u));
-        Node* term2 = makeOp('*', cloneTree(v), u_div);
+                if (std::fabs(n) < 1e-12) {
+                    freeTree(du);
+                    ds.push_back(makeNum(0));   // u^0 = 1Ϊ 0
+                }
+                else if (std::fabs(n - 1.0) < 1e-12) {
+                    ds.push_back(du);           // u^1 = uΪ u'
+                }
+                else if (dlZero) {
+                    ds.push_back(du);
+                }
+                else {
+                    Node* coef  = makeNum(n);
+                    Node* power = makeOpFold('^', cloneTree(u), makeNum(n - 1.0));
+                    ds.push_back(makeOpFold('*', makeOpFold('*', coef, power), du));
+                }
+            }
+            // ߵΪ 0ָ var
+            else if (dlZero && drZero) {
+                freeTree(dv);
+                ds.push_back(du);
+            }
+            // ͨu^v * ( v' * ln(u) + v * (u'/u) )
+            else {
+                Node* term1 = drZero ? dv : makeOpFold('*', dv, makeFunc("ln", cloneTree(u)));
+                Node* term2 = dlZero ? du : makeOpFold('*', cloneTree(v), makeOpFold('/', du, cloneTree(u)));
 
-        Node* inside = makeOp('+', term1, term2);
-        Node* outer  = makeOp('^', cloneTree(u), cloneTree(v));
+                Node* inside = makeOpFold('+', term1, term2);
+                Node* outer  = makeOp('^', cloneTree(u), cloneTree(v));
 
-        return makeOp('*', outer, inside);
+                ds.push_back(makeOpFold('*', outer, inside));
+            }
+        }
     }
-
-    if (err) *err = "δ֪޷";
-    return nullptr;
+    return ds.back();
 }
 
 // Աʽƫµıʽ
 inline ExprTree DerivativeTree(const ExprTree& T, char var, string* err) {
     ExprTree D;
     if (!T.root) { if (err) *err = "ձʽ"; return D; }
+    NodeArenaScope scope(D.ensureArena());
     Node* r = derivNode(T.root, var, err);
-    if (!r) return D;
+    if (!r) { D.arena.reset(); return D; }
     D.root = r;
 	D.postfixRaw = "<derivative>";  // Ϊʽ
     return D;
@@ -504,30 +1640,174 @@ inline ExprTree DerivativeTree(const ExprTree& T, char var, string* err) {
 
 // ===================== ֽṹ =====================
 
-// ڵλýṹ
-struct LayoutNodePos {
-    int x;
-    int y;
+// ƽ֣ڵ㰴 0..n-1ڵСӽڵ㣬Ϊ 0
+// ͸ڵŴУƱ/ڵ͵ѡǶɨ
+struct Layout {
+    vector<Node*> nodes;   //  -> ڵ
+    vector<int> x, y;      //  -> 
+    vector<int> parent;    //  -> ڵţΪ -1
+    // Ա i Ϊռ [i, subtreeEnd[i])ΧΪ [boxX0, boxX1] x [boxY0, boxY1]
+    // ʱݴ޳ӿѹСһۺͼΣ
+    vector<int> subtreeEnd;
+    vector<int> boxX0, boxY0, boxX1, boxY1;
+
+    size_t size() const { return nodes.size(); }
+    bool empty() const { return nodes.empty(); }
+
+    void clear() {
+        nodes.clear();
+        x.clear();
+        y.clear();
+        parent.clear();
+        subtreeEnd.clear();
+        boxX0.clear();
+        boxY0.clear();
+        boxX1.clear();
+        boxY1.clear();
+        cellStart.clear();
+        cellItems.clear();
+    }
+
+    // ڵڱеıţڲз -1O(1)żڽڵϣ nodes У飩
+    int indexOf(const Node* p) const {
+        if (!p || p->layoutIdx < 0 || (size_t)p->layoutIdx >= nodes.size()) return -1;
+        return nodes[p->layoutIdx] == p ? p->layoutIdx : -1;
+    }
+
+    // ͸ڵżıΧУӽڵܴڸڵ㣬һ鼴ɣ
+    void buildBounds() {
+        size_t n = size();
+        subtreeEnd.assign(n, 0);
+        boxX0 = x;
+        boxX1 = x;
+        boxY0 = y;
+        boxY1 = y;
+        for (size_t i = n; i-- > 0;) {
+            if (subtreeEnd[i] == 0) subtreeEnd[i] = (int)i + 1;   // Ҷ
+            int p = parent[i];
+            if (p < 0) continue;
+            subtreeEnd[p] = (std::max)(subtreeEnd[p], subtreeEnd[i]);
+            boxX0[p] = (std::min)(boxX0[p], boxX0[i]);
+            boxX1[p] = (std::max)(boxX1[p], boxX1[i]);
+            boxY0[p] = (std::min)(boxY0[p], boxY0[i]);
+            boxY1[p] = (std::max)(boxY1[p], boxY1[i]);
+        }
+    }
+
+    // ---------- ѡõľ ----------
+
+    // ѽڵͰͰڱţcellSize Ϊ 0 ʱƽÿԼ 4 ڵԶѡȡ
+    // 仯µãδʱ forEachNear ˻Ϊȫڵ
+    void buildGrid(int cellSize = 0) {
+        cellStart.clear();
+        cellItems.clear();
+        if (nodes.empty()) return;
+
+        int minX = x[0], maxX = x[0], minY = y[0], maxY = y[0];
+        for (size_t i = 1; i < size(); ++i) {
+            minX = (std::min)(minX, x[i]);
+            maxX = (std::max)(maxX, x[i]);
+            minY = (std::min)(minY, y[i]);
+            maxY = (std::max)(maxY, y[i]);
+        }
+        double w = (double)maxX - minX + 1, h = (double)maxY - minY + 1;
+        if (cellSize <= 0) cellSize = (int)std::ceil(std::sqrt(w * h * 4 / (double)size()));
+        if (cellSize < 1) cellSize = 1;
+
+        gridX0 = minX;
+        gridY0 = minY;
+        cell = cellSize;
+        cols = (int)(w / cellSize) + 1;
+        rows = (int)(h / cellSize) + 1;
+
+        // ÿĽڵٰǰ׺ͷ
+        cellStart.assign((size_t)cols * rows + 1, 0);
+        for (size_t i = 0; i < size(); ++i) ++cellStart[cellOf((int)i) + 1];
+        for (size_t c = 1; c < cellStart.size(); ++c) cellStart[c] += cellStart[c - 1];
+        cellItems.resize(size());
+        vector<int> fill(cellStart.begin(), cellStart.end() - 1);
+        for (size_t i = 0; i < size(); ++i) cellItems[fill[cellOf((int)i)]++] = (int)i;
+    }
+
+    //  (cx, cy) Ϊġ߳ r ڵĽڵ fn()
+    // Ǻѡ÷ȷľжϣ˳򲻱֤ţ
+    template <class Fn>
+    void forEachNear(double cx, double cy, double r, Fn fn) const {
+        if (cellStart.empty()) {
+            for (size_t i = 0; i < size(); ++i) fn((int)i);
+            return;
+        }
+        double c0 = std::floor((cx - r - gridX0) / cell), c1 = std::floor((cx + r - gridX0) / cell);
+        double r0 = std::floor((cy - r - gridY0) / cell), r1 = std::floor((cy + r - gridY0) / cell);
+        if (!(c1 >= 0 && c0 < cols && r1 >= 0 && r0 < rows)) return;   // ཻ NaN
+        int colLo = (int)(std::max)(c0, 0.0), colHi = (int)(std::min)(c1, cols - 1.0);
+        int rowLo = (int)(std::max)(r0, 0.0), rowHi = (int)(std::min)(r1, rows - 1.0);
+        for (int row = rowLo; row <= rowHi; ++row)
+            for (int k = cellStart[(size_t)row * cols + colLo]; k < cellStart[(size_t)row * cols + colHi + 1]; ++k)
+                fn(cellItems[k]);
+    }
+
+private:
+    int gridX0 = 0, gridY0 = 0, cell = 1, cols = 0, rows = 0;
+    vector<int> cellStart;   //  c Ľڵ cellItems[cellStart[c], cellStart[c+1]) 
+    vector<int> cellItems;   // еĽڵ
+
+    size_t cellOf(int i) const {
+        return (size_t)((y[i] - gridY0) / cell) * cols + (size_t)((x[i] - gridX0) / cell);
+    }
 };
 
-struct Layout {
-    std::map<Node*, LayoutNodePos> pos;
+// ַʽ
+enum LayoutMode {
+    LAYOUT_CLASSIC = 0,   // layoutTreeݼĹ̶ƫƣŵ
+    LAYOUT_TIDY = 1,      // TidyLayoutReingoldCTilford ղ֣ͬڵ㻥ص
 };
 
-// ݹĲ֣Ƕȵݼ + ϶̣
+// ѲֵȱС maxWidth x maxHeight ڣ԰ΧжеΪ׼Ƶ (x, y)
+// űС minScaleֱڷΧʱκθĶ
+inline void fitLayout(Layout& L, int x, int y, int maxWidth, int maxHeight, double minScale = 0) {
+    if (L.empty()) return;
+    int minX = L.x[0], maxX = L.x[0], minY = L.y[0], maxY = L.y[0];
+    for (size_t i = 1; i < L.size(); ++i) {
+        if (L.x[i] < minX) minX = L.x[i];
+        if (L.x[i] > maxX) maxX = L.x[i];
+        if (L.y[i] < minY) minY = L.y[i];
+        if (L.y[i] > maxY) maxY = L.y[i];
+    }
+
+    int currentWidth = maxX - minX;
+    int currentHeight = maxY - minY;
+
+    // űȱţ
+    double scaleX = (currentWidth > maxWidth) ? (double)maxWidth / currentWidth : 1.0;
+    double scaleY = (currentHeight > maxHeight) ? (double)maxHeight / currentHeight : 1.0;
+    double scale = (std::max)((std::min)(scaleX, scaleY), minScale);
+
+    // Ҫţµнڵλ
+    if (scale < 1.0) {
+        int centerX = (minX + maxX) / 2;
+        int centerY = minY;
+
+        for (size_t i = 0; i < L.size(); ++i) {
+            L.x[i] = x + (int)((L.x[i] - centerX) * scale);
+            L.y[i] = y + (int)((L.y[i] - centerY) * scale);
+        }
+    }
+}
+
+// Ĳ֣Ƕȵݼ + ϶̣ʽջʵ֣
 inline Layout layoutTree(Node* root, int x, int y, int xGap, int yGap,
     int maxWidth = 700, int maxHeight = 350) {
+    (void)xGap;
+    (void)yGap;
     Layout L;
     if (!root) return L;
 
-    // 
-    std::function<int(Node*)> calcDepth = [&](Node* p) -> int {
-        if (!p) return 0;
-        return 1 + (std::max)(calcDepth(p->l), calcDepth(p->r));
-        };
-
-    int depth = calcDepth(root);
-    if (depth == 0) return L;
+    size_t n = treeNodeCount(root);
+    L.nodes.reserve(n);
+    L.x.reserve(n);
+    L.y.reserve(n);
+    L.parent.reserve(n);
 
     // ʼˮƽƫСֵ߸̣
     const int baseOffset = 80;
@@ -536,57 +1816,340 @@ inline Layout layoutTree(Node* root, int x, int y, int xGap, int yGap,
     // ˥ӣ0.65 ýǶСص
     const double decayFactor = 0.65;
 
-    // һ鲼֣Ƕݼ
-    std::function<void(Node*, int, int, double)> layout = [&](Node* p, int cx, int cy, double offset) {
-        if (!p) return;
-        L.pos[p] = { cx, cy };
+    // һ鲼֣Ƕݼѹ֤ȱţ
+    struct Frame {
+        Node* p;
+        int parent;
+        int cx, cy;
+        double offset;
+    };
+    vector<Frame> st;
+    st.push_back({ root, -1, x, y, (double)baseOffset });
+    while (!st.empty()) {
+        Frame f = st.back();
+        st.pop_back();
+
+        int idx = (int)L.nodes.size();
+        f.p->layoutIdx = idx;
+        L.nodes.push_back(f.p);
+        L.x.push_back(f.cx);
+        L.y.push_back(f.cy);
+        L.parent.push_back(f.parent);
 
         // һƫ
-        double nextOffset = offset * decayFactor;
+        double nextOffset = f.offset * decayFactor;
         if (nextOffset < 25) nextOffset = 25;  // Сƫ
 
-        if (p->l) {
-            layout(p->l, cx - (int)offset, cy + shortYGap, nextOffset);
+        if (f.p->r) st.push_back({ f.p->r, idx, f.cx + (int)f.offset, f.cy + shortYGap, nextOffset });
+        if (f.p->l) st.push_back({ f.p->l, idx, f.cx - (int)f.offset, f.cy + shortYGap, nextOffset });
+    }
+
+    // ڶ飺ʱȱС
+    fitLayout(L, x, y, maxWidth, maxHeight);
+    L.buildBounds();
+    return L;
+}
+
+// ===================== ֣ReingoldCTilford =====================
+
+// ͬڽڵľ಻С xGapΪ yGapڵλӽڵУӽڵʱϷ
+// ÿڵֻ¼ԸڵĺƫƣϲʱͬУ
+// ֮С롣ڽǳáҶָһڵ㣩ӵϣ
+// ÿڵĺϲֻ߽ϰĸ߶ȣ O(n)
+//
+// ϲڵ㻺棺ֲ޸ĺֻ޸Ĵ·invalidateδĶֱӸ
+// ĲλУλ֮±껥ãкۼӶϣ
+// ֻ·ϵĽڵ½ڵҪָҲλ
+class TidyLayout {
+public:
+    // ֣棩
+    Layout layout(Node* root, int x, int y, int xGap, int yGap, int maxWidth = 700, int maxHeight = 350) {
+        clear();
+        return relayout(root, x, y, xGap, yGap, maxWidth, maxHeight);
+    }
+
+    // ֣ϴβ֮ÿ޸Ķ invalidate/forget Ǽǣ
+    // ʱֻǼǹĽڵ㵽·û棻λһ
+    Layout relayout(Node* root, int x, int y, int xGap, int yGap, int maxWidth = 700, int maxHeight = 350) {
+        Layout L;
+        if (!root) return L;
+        if (root != lastRoot || xGap != gap) {
+            clear();
+            lastRoot = root;
+            gap = xGap;
         }
-        if (p->r) {
-            layout(p->r, cx + (int)offset, cy + shortYGap, nextOffset);
+        if (slotOf.empty()) {
+            size_t n = treeNodeCount(root);
+            slotOf.reserve(n);
+            slots.reserve(n);
         }
-        };
 
-    layout(root, x, y, (double)baseOffset);
+        int rs = computeTree(root);
+        slots[rs].parent = -1;
+        slots[rs].dx = 0;
+        place(rs, x, y, yGap, L);
+        fitLayout(L, x, y, maxWidth, maxHeight, TIDY_MIN_SCALE);
+        L.buildBounds();
+        return L;
+    }
 
-    // ڶ飺߽粢ǷҪ
-    int minX = x, maxX = x, minY = y, maxY = y;
-    for (auto& kv : L.pos) {
-        if (kv.second.x < minX) minX = kv.second.x;
-        if (kv.second.x > maxX) maxX = kv.second.x;
-        if (kv.second.y < minY) minY = kv.second.y;
-        if (kv.second.y > maxY) maxY = kv.second.y;
+    // Ǽǣp Ķp 滻ӽڵ仯p Ҫ
+    // ޸֮ǰãҪõ p ¼ĸڵ㣩
+    void invalidate(const Node* p) {
+        auto it = slotOf.find(p);
+        if (it == slotOf.end()) return;
+        for (int s = it->second; s >= 0 && !slots[s].dirty; s = slots[s].parent)
+            slots[s].dirty = true;
     }
 
-    int currentWidth = maxX - minX;
-    int currentHeight = maxY - minY;
+    // ǼǣͷţнڵĻ棨½ڵ㸴Щַʱþɽ
+    void forget(Node* subtree) {
+        vector<Node*> st;
+        if (subtree) st.push_back(subtree);
+        while (!st.empty()) {
+            Node* p = st.back();
+            st.pop_back();
+            auto it = slotOf.find(p);
+            if (it != slotOf.end()) {
+                freeSlots.push_back(it->second);
+                slotOf.erase(it);
+            }
+            if (p->l) st.push_back(p->l);
+            if (p->r) st.push_back(p->r);
+        }
+    }
 
-    // űȱţ
-    double scaleX = (currentWidth > maxWidth) ? (double)maxWidth / currentWidth : 1.0;
-    double scaleY = (currentHeight > maxHeight) ? (double)maxHeight / currentHeight : 1.0;
-    double scale = (std::min)(scaleX, scaleY);
+    // Ǽǣڵ㱻ͬݵĸȡExprTree::copyPathļǵ
+    void rename(const Node* from, Node* to) {
+        auto it = slotOf.find(from);
+        if (it != slotOf.end()) {
+            int s = it->second;
+            slotOf.erase(it);
+            slotOf[to] = s;
+            slots[s].node = to;
+        }
+        if (lastRoot == from) lastRoot = to;
+    }
 
-    // Ҫţµнڵλ
-    if (scale < 1.0) {
-        int centerX = (minX + maxX) / 2;
-        int centerY = minY;
+    void clear() {
+        slots.clear();
+        freeSlots.clear();
+        slotOf.clear();
+        lastRoot = nullptr;
+    }
 
-        for (auto& kv : L.pos) {
-            int dx = kv.second.x - centerX;
-            int dy = kv.second.y - centerY;
-            kv.second.x = x + (int)(dx * scale);
-            kv.second.y = y + (int)(dy * scale);
+private:
+    // ܿʱֲڣڵ㼷һţСñ࿿/϶鿴
+    static constexpr double TIDY_MIN_SCALE = 0.25;
+
+    struct Info {
+        Node* node = nullptr;
+        int l = -1, r = -1;         // ӽڵĲλ
+        int parent = -1;            // ڵĲλ
+        double dx = 0;              // Ըڵĺƫƣɸڵϲʱд룩
+        int thread = -1;            // Ҷӣһڵ
+        double threadDx = 0;        // ڵԱڵĺƫ
+        int ll = -1, rr = -1;       // һ/ҽڵ
+        double llDx = 0, rrDx = 0;  // ll/rr Աڵĺƫ
+        int height = 0;             // ߶ȣҶΪ 0
+        bool dirty = true;          // Ҫ
+    };
+
+    vector<Info> slots;
+    vector<int> freeSlots;
+    std::unordered_map<const Node*, int> slotOf;
+    const Node* lastRoot = nullptr;
+    int gap = 0;
+
+    int newSlot(Node* p) {
+        int s;
+        if (!freeSlots.empty()) {
+            s = freeSlots.back();
+            freeSlots.pop_back();
+            slots[s] = Info();
+        }
+        else {
+            s = (int)slots.size();
+            slots.push_back(Info());
         }
+        slots[s].node = p;
+        slotOf[p] = s;
+        return s;
     }
 
-    return L;
-}
+    // һڵ㣨x Ϊǰڵĳһ׼ƫƣ֮£ûʱ -1
+    int nextRight(int v, double& x) const {
+        const Info& I = slots[v];
+        int c = I.r >= 0 ? I.r : I.l;
+        if (c >= 0) {
+            x += slots[c].dx;
+            return c;
+        }
+        x += I.threadDx;
+        return I.thread;
+    }
+
+    int nextLeft(int v, double& x) const {
+        const Info& I = slots[v];
+        int c = I.l >= 0 ? I.l : I.r;
+        if (c >= 0) {
+            x += slots[c].dx;
+            return c;
+        }
+        x += I.threadDx;
+        return I.thread;
+    }
+
+    // 㣬ظĲλЧ
+    int computeTree(Node* root) {
+        struct Frame {
+            Node* p;
+            int slot;
+            bool expanded;   // ӽڵǷջ
+        };
+        vector<Frame> st;
+        vector<int> done;    // λӽڵĽڸڵϲʱȡ
+        st.push_back({ root, -1, false });
+        while (!st.empty()) {
+            Frame& f = st.back();
+            if (!f.expanded) {
+                auto it = slotOf.find(f.p);
+                if (it != slotOf.end() && !slots[it->second].dirty) {
+                    done.push_back(it->second);
+                    st.pop_back();
+                    continue;
+                }
+                // λںϲ֮ǰãϲʱ slots
+                f.slot = (it != slotOf.end()) ? it->second : newSlot(f.p);
+                f.expanded = true;
+                Node* p = f.p;
+                if (p->r) st.push_back({ p->r, -1, false });
+                if (p->l) st.push_back({ p->l, -1, false });
+                continue;
+            }
+            Node* p = f.p;
+            int s = f.slot;
+            st.pop_back();
+            Info& I = slots[s];
+            I.r = p->r ? popBack(done) : -1;
+            I.l = p->l ? popBack(done) : -1;
+            merge(s);
+            done.push_back(s);
+        }
+        return done.back();
+    }
+
+    static int popBack(vector<int>& v) {
+        int x = v.back();
+        v.pop_back();
+        return x;
+    }
+
+    // ӽڵĽλ s Ľڷӽڵ
+    void merge(int s) {
+        Info& I = slots[s];
+        I.dirty = false;
+        I.thread = -1;
+        I.threadDx = 0;
+
+        int a = I.l, b = I.r;
+        if (a < 0 && b < 0) {
+            I.ll = I.rr = s;
+            I.llDx = I.rrDx = 0;
+            I.height = 0;
+            return;
+        }
+        if (a < 0 || b < 0) {
+            // ӽڵ·
+            Info& C = slots[a >= 0 ? a : b];
+            C.parent = s;
+            C.dx = 0;
+            clearThreads(C);
+            I.ll = C.ll;
+            I.rr = C.rr;
+            I.llDx = C.llDx;
+            I.rrDx = C.rrDx;
+            I.height = C.height + 1;
+            return;
+        }
+
+        Info& A = slots[a];
+        Info& B = slots[b];
+        A.parent = B.parent = s;
+        // ҶϿϴκϲʱõ
+        clearThreads(A);
+        clearThreads(B);
+
+        // ͬ u  vxaxb ֱ ab ab С d
+        double d = gap, xa = 0, xb = 0;
+        int u = a, v = b;
+        while (true) {
+            u = nextRight(u, xa);
+            v = nextLeft(v, xb);
+            if (u < 0 || v < 0) break;
+            d = (std::max)(d, xa - xb + gap);
+        }
+        A.dx = -d / 2;
+        B.dx = d / 2;
+
+        // ϰһϽϸһһڵ
+        if (A.height < B.height) {
+            Info& T = slots[A.ll];
+            T.thread = v;
+            T.threadDx = (B.dx + xb) - (A.dx + A.llDx);
+        }
+        else if (B.height < A.height) {
+            Info& T = slots[B.rr];
+            T.thread = u;
+            T.threadDx = (A.dx + xa) - (B.dx + B.rrDx);
+        }
+
+        const Info& Lo = (B.height > A.height) ? B : A;   // һڵ
+        const Info& Ro = (A.height > B.height) ? A : B;   // һҽڵ
+        I.ll = Lo.ll;
+        I.llDx = Lo.dx + Lo.llDx;
+        I.rr = Ro.rr;
+        I.rrDx = Ro.dx + Ro.rrDx;
+        I.height = (std::max)(A.height, B.height) + 1;
+    }
+
+    void clearThreads(const Info& C) {
+        slots[C.ll].thread = -1;
+        slots[C.rr].thread = -1;
+    }
+
+    // ۼƫƵõ꣬дɱƽ֣Źͬ layoutTree
+    void place(int rootSlot, int x, int y, int yGap, Layout& L) {
+        size_t n = slotOf.size();
+        L.nodes.reserve(n);
+        L.x.reserve(n);
+        L.y.reserve(n);
+        L.parent.reserve(n);
+
+        struct Frame {
+            int s;
+            int parent;
+            double cx;
+            int cy;
+        };
+        vector<Frame> st;
+        st.push_back({ rootSlot, -1, (double)x, y });
+        while (!st.empty()) {
+            Frame f = st.back();
+            st.pop_back();
+            const Info& I = slots[f.s];
+            int idx = (int)L.nodes.size();
+            I.node->layoutIdx = idx;
+            L.nodes.push_back(I.node);
+            L.x.push_back((int)std::floor(f.cx + 0.5));
+            L.y.push_back(f.cy);
+            L.parent.push_back(f.parent);
+            if (I.r >= 0) st.push_back({ I.r, idx, f.cx + slots[I.r].dx, f.cy + yGap });
+            if (I.l >= 0) st.push_back({ I.l, idx, f.cx + slots[I.l].dx, f.cy + yGap });
+        }
+    }
+};
+
 // ===================== ȡϵͻ =====================
 
 // һȡϵͻ
@@ -627,97 +2190,110 @@ inline void extractCoefAndBase(Node* p, Node*& base, double& coef) {
 // ===================== жǷṹͬ =====================
 
 inline bool treesEqual(Node* a, Node* b) {
-    if (!a && !b) return true;
-    if (!a || !b) return false;
-    if (a->kind != b->kind) return false;
-    if (a->kind == 'N') return std::fabs(a->num - b->num) < 1e-12;
-    if (a->kind == 'V') return a->ch == b->ch;
-    if (a->kind == 'F') {
-        if (a->ch != b->ch) return false;
-        return treesEqual(a->l, b->l);
+    vector<std::pair<Node*, Node*>> st;
+    st.push_back({ a, b });
+    while (!st.empty()) {
+        Node* x = st.back().first;
+        Node* y = st.back().second;
+        st.pop_back();
+        if (!x && !y) continue;
+        if (!x || !y) return false;
+        if (x->kind != y->kind) return false;
+        if (x->kind == 'N') {
+            if (std::fabs(x->num - y->num) >= 1e-12) return false;
+            continue;
+        }
+        if (x->kind == 'V') {
+            if (x->ch != y->ch) return false;
+            continue;
+        }
+        // һԪֻȽڵȽ
+        if (x->ch != y->ch) return false;
+        if (x->kind != 'F') st.push_back({ x->r, y->r });
+        st.push_back({ x->l, y->l });
     }
-    // ڵ
-    if (a->ch != b->ch) return false;
-    return treesEqual(a->l, b->l) && treesEqual(a->r, b->r);
+    return true;
 }
 
 // ===================== ռӷе =====================
 
 inline void collectAddTerms(Node* p, std::vector<Node*>& terms) {
-    if (!p) return;
-    if (p->kind == 'O' && p->ch == '+') {
-        collectAddTerms(p->l, terms);
-        collectAddTerms(p->r, terms);
-    }
-    else {
-        terms.push_back(p);
+    std::vector<Node*> st;  // ѹѹ󣬱ִҵ˳
+    if (p) st.push_back(p);
+    while (!st.empty()) {
+        Node* q = st.back();
+        st.pop_back();
+        if (q->kind == 'O' && q->ch == '+') {
+            if (q->r) st.push_back(q->r);
+            if (q->l) st.push_back(q->l);
+        }
+        else {
+            terms.push_back(q);
+        }
     }
 }
 
 // ===================== ռ˷е =====================
 
 inline void collectMulTerms(Node* p, std::vector<Node*>& terms) {
-    if (!p) return;
-    if (p->kind == 'O' && p->ch == '*') {
-        collectMulTerms(p->l, terms);
-        collectMulTerms(p->r, terms);
-    }
-    else {
-        terms.push_back(p);
+    std::vector<Node*> st;  // ѹѹ󣬱ִҵ˳
+    if (p) st.push_back(p);
+    while (!st.empty()) {
+        Node* q = st.back();
+        st.pop_back();
+        if (q->kind == 'O' && q->ch == '*') {
+            if (q->r) st.push_back(q->r);
+            if (q->l) st.push_back(q->l);
+        }
+        else {
+            terms.push_back(q);
+        }
     }
 }
 // ===================== 滻Ϊ =====================
 
-// Ѹֵı滻Ϊڵ
+// Ѹֵı滻Ϊڵ㣨½ڵ䵽ǰ arena
 inline Node* substituteVars(Node* p, const std::map<char, double>& varVals) {
-    if (!p) return nullptr;
-
-    // ǱڵѸֵ滻Ϊֽڵ
-    if (p->kind == 'V') {
-        auto it = varVals.find(p->ch);
-        if (it != varVals.end()) {
-            Node* numNode = makeNum(it->second);
-            return numNode;
+    Node* root = nullptr;
+    vector<std::pair<Node*, Node**>> st;  // (Դڵ, ½ڵӦдλ)
+    st.push_back({ p, &root });
+    while (!st.empty()) {
+        Node* src = st.back().first;
+        Node** dst = st.back().second;
+        st.pop_back();
+        if (!src) { *dst = nullptr; continue; }
+
+        // ǱڵѸֵ滻Ϊֽڵ㣻δֵı¡
+        if (src->kind == 'V') {
+            auto it = varVals.find(src->ch);
+            *dst = (it != varVals.end()) ? makeNum(it->second) : cloneTree(src);
+            continue;
         }
-        // δֵı¡
-        return cloneTree(p);
-    }
-
-    // ֽڵֱӿ¡
-    if (p->kind == 'N') {
-        return cloneTree(p);
-    }
 
-    // һԪڵ
-    if (p->kind == 'F') {
-        Node* newNode = new Node();
-        newNode->kind = 'F';
-        newNode->ch = p->ch;
-        newNode->l = substituteVars(p->l, varVals);
-        newNode->r = nullptr;
-        return newNode;
-    }
+        // һԪ / Ԫڵ㣺ӽڵԺд
+        if (src->kind == 'F' || src->kind == 'O') {
+            Node* newNode = allocNode();
+            newNode->kind = src->kind;
+            newNode->ch = src->ch;
+            *dst = newNode;
+            if (src->kind == 'O') st.push_back({ src->r, &newNode->r });
+            st.push_back({ src->l, &newNode->l });
+            continue;
+        }
 
-    // Ԫڵ
-    if (p->kind == 'O') {
-        Node* newNode = new Node();
-        newNode->kind = 'O';
-        newNode->ch = p->ch;
-        newNode->l = substituteVars(p->l, varVals);
-        newNode->r = substituteVars(p->r, varVals);
-        return newNode;
+        // ֽڵֱӿ¡
+        *dst = cloneTree(src);
     }
-
-    return cloneTree(p);
+    return root;
 }
 // ===================== ʽ֧ͬϲ + ϵϲ =====================
 
-inline Node* simplifyNode(Node* p) {
+// ӽڵѻĽڵ p Ӧõ㻯򣬷滻 p Ľڵ
+// again Ϊ true ʾǺϲͬؽҪ廯һ
+inline Node* simplifyLocal(Node* p, bool& again) {
+    again = false;
     if (!p) return nullptr;
 
-    p->l = simplifyNode(p->l);
-    p->r = simplifyNode(p->r);
-
     // һԪǳֱӼ
     if (p->kind == 'F') {
         double v = 0;
@@ -737,7 +2313,7 @@ inline Node* simplifyNode(Node* p) {
             if (valid) {
                 freeTree(p->l);
                 p->l = nullptr;
-                delete p;
+                releaseNode(p);
                 return makeNum(result);
             }
         }
@@ -768,7 +2344,7 @@ inline Node* simplifyNode(Node* p) {
             if (valid) {
                 freeTree(p->l); freeTree(p->r);
                 p->l = p->r = nullptr;
-                delete p;
+                releaseNode(p);
                 return makeNum(result);
             }
         }
@@ -844,7 +2420,8 @@ inline Node* simplifyNode(Node* p) {
 
                     // ȫͷԭ
                     freeTree(p);
-                    return simplifyNode(result);
+                    again = true;
+                    return result;
                 }
             }
         }
@@ -922,7 +2499,8 @@ inline Node* simplifyNode(Node* p) {
 
                     //ȫͷԭ
                     freeTree(p);
-                    return simplifyNode(result);
+                    again = true;
+                    return result;
                 }
             }
         }
@@ -931,12 +2509,12 @@ inline Node* simplifyNode(Node* p) {
         if (op == '+') {
             if (rConst && std::fabs(rv) < 1e-12) {
                 Node* ret = p->l; p->l = nullptr;
-                freeTree(p->r); delete p;
+                freeTree(p->r); releaseNode(p);
                 return ret;
             }
             if (lConst && std::fabs(lv) < 1e-12) {
                 Node* ret = p->r; p->r = nullptr;
-                freeTree(p->l); delete p;
+                freeTree(p->l); releaseNode(p);
                 return ret;
             }
         }
@@ -944,7 +2522,7 @@ inline Node* simplifyNode(Node* p) {
         // x - 0 = x
         if (op == '-' && rConst && std::fabs(rv) < 1e-12) {
             Node* ret = p->l; p->l = nullptr;
-            freeTree(p->r); delete p;
+            freeTree(p->r); releaseNode(p);
             return ret;
         }
 
@@ -953,17 +2531,17 @@ inline Node* simplifyNode(Node* p) {
             if ((rConst && std::fabs(rv) < 1e-12) || (lConst && std::fabs(lv) < 1e-12)) {
                 freeTree(p->l); freeTree(p->r);
                 p->l = p->r = nullptr;
-                delete p;
+                releaseNode(p);
                 return makeNum(0);
             }
             if (rConst && std::fabs(rv - 1) < 1e-12) {
                 Node* ret = p->l; p->l = nullptr;
-                freeTree(p->r); delete p;
+                freeTree(p->r); releaseNode(p);
                 return ret;
             }
             if (lConst && std::fabs(lv - 1) < 1e-12) {
                 Node* ret = p->r; p->r = nullptr;
-                freeTree(p->l); delete p;
+                freeTree(p->l); releaseNode(p);
                 return ret;
             }
         }
@@ -971,7 +2549,7 @@ inline Node* simplifyNode(Node* p) {
         // x / 1 = x
         if (op == '/' && rConst && std::fabs(rv - 1) < 1e-12) {
             Node* ret = p->l; p->l = nullptr;
-            freeTree(p->r); delete p;
+            freeTree(p->r); releaseNode(p);
             return ret;
         }
 
@@ -980,12 +2558,12 @@ inline Node* simplifyNode(Node* p) {
             if (rConst && std::fabs(rv) < 1e-12) {
                 freeTree(p->l); freeTree(p->r);
                 p->l = p->r = nullptr;
-                delete p;
+                releaseNode(p);
                 return makeNum(1);
             }
             if (rConst && std::fabs(rv - 1) < 1e-12) {
                 Node* ret = p->l; p->l = nullptr;
-                freeTree(p->r); delete p;
+                freeTree(p->r); releaseNode(p);
                 return ret;
             }
         }
@@ -994,4 +2572,31 @@ inline Node* simplifyNode(Node* p) {
     return p;
 }
 
+// ʽʽջȻԭ滻ָ룩ٶԽڵӦ simplifyLocal
+inline Node* simplifyNode(Node* root) {
+    struct Frame {
+        Node* p;
+        Node** slot;    // дصλãڵָ result
+        bool expanded;  // ӽڵǷѻ
+    };
+    Node* result = root;
+    vector<Frame> st;
+    if (root) st.push_back({ root, &result, false });
+    while (!st.empty()) {
+        Frame f = st.back();
+        st.pop_back();
+        if (!f.expanded) {
+            st.push_back({ f.p, f.slot, true });
+            if (f.p->r) st.push_back({ f.p->r, &f.p->r, false });
+            if (f.p->l) st.push_back({ f.p->l, &f.p->l, false });
+            continue;
+        }
+        bool again = false;
+        Node* q = simplifyLocal(f.p, again);
+        *f.slot = q;
+        if (again && q) st.push_back({ q, f.slot, false });
+    }
+    return result;
+}
+
 #endif // PPE_H
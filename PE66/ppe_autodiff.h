@@ -0,0 +1,352 @@
+#ifndef PPE_AUTODIFF_H
+#define PPE_AUTODIFF_H
+
+#include "ppe_compile.h"
+#include "ppe_batch.h"
+
+#include <limits>
+
+// ===================== ǰģʽԶ΢֣ż =====================
+
+// һαͬʱʽֵͶĳƫɵ
+// 󵼷 derivNode ֵͬͱ㡢ln δֵȣ eval һ£
+// ݶԵĵ v*u^(v-1)*u' 㣬˵ΪҲ󵼣
+// ָĵ u^v*ln(u)*v' ڵ <= 0 ʱ޶壬ʱֵճΪ NaN
+
+// żֵ v Ͷ󵼱ĵ d
+struct Dual {
+    double v;
+    double d;
+};
+
+inline Dual dualAdd(Dual a, Dual b) { return { a.v + b.v, a.d + b.d }; }
+inline Dual dualSub(Dual a, Dual b) { return { a.v - b.v, a.d - b.d }; }
+
+// (u * v)' = u'*v + u*v'
+inline Dual dualMul(Dual a, Dual b) { return { a.v * b.v, a.d * b.v + a.v * b.d }; }
+
+// (u / v)' = (u'*v - u*v') / v^2
+inline bool dualDiv(Dual& a, Dual b, string* err) {
+    if (std::fabs(b.v) < 1e-12) { if (err) *err = ""; return false; }
+    a = { a.v / b.v, (a.d * b.v - a.v * b.d) / (b.v * b.v) };
+    return true;
+}
+
+// ָΪ 0n*u^(n-1)*u' u^v * (v'*ln(u) + v*u'/u)u <= 0 ʱΪ NaN
+inline Dual dualPow(Dual a, Dual b) {
+    double value = std::pow(a.v, b.v);
+    double d;
+    if (b.d == 0) d = (a.d == 0 || b.v == 0) ? 0 : b.v * std::pow(a.v, b.v - 1) * a.d;
+    else if (a.v > 0) d = value * (b.d * std::log(a.v) + b.v * a.d / a.v);
+    else d = std::numeric_limits<double>::quiet_NaN();
+    return { value, d };
+}
+
+// sin(u)' = cos(u)*u'cos(u)' = -sin(u)*u'tan(u)' = u'/cos(u)^2
+inline Dual dualSin(Dual a) { return { std::sin(a.v), std::cos(a.v) * a.d }; }
+inline Dual dualCos(Dual a) { return { std::cos(a.v), -std::sin(a.v) * a.d }; }
+inline Dual dualTan(Dual a) {
+    double c = std::cos(a.v);
+    return { std::tan(a.v), a.d / (c * c) };
+}
+
+// ln(u)' = u'/u
+inline bool dualLn(Dual& a, string* err) {
+    if (a.v <= 0) { if (err) *err = "ln  > 0"; return false; }
+    a = { std::log(a.v), a.d / a.v };
+    return true;
+}
+
+// ֱڱʽֵƫ ExprTree::eval ͬʽջʺֻһεĳϣ
+inline bool evalDerivative(const ExprTree& T, const std::map<char, double>& vars, char var,
+    double& value, double& deriv, string* err) {
+    vector<std::pair<Node*, bool>> st;  // (ڵ, ӽڵǷֵ)
+    vector<Dual> vals;
+    st.push_back({ T.root, false });
+
+    while (!st.empty()) {
+        Node* p = st.back().first;
+        bool expanded = st.back().second;
+        st.pop_back();
+
+        if (!p) { if (err) *err = "սڵ"; return false; }
+
+        if (p->kind == 'N') { vals.push_back({ p->num, 0 }); continue; }
+
+        if (p->kind == 'V') {
+            auto it = vars.find(p->ch);
+            if (it == vars.end()) {
+                if (err) *err = "δֵ: " + varNameFromCode(p->ch);
+                return false;
+            }
+            vals.push_back({ it->second, p->ch == var ? 1.0 : 0.0 });
+            continue;
+        }
+
+        if (!expanded) {
+            st.push_back({ p, true });
+            if (p->kind != 'F') st.push_back({ p->r, false });
+            st.push_back({ p->l, false });
+            continue;
+        }
+
+        if (p->kind == 'F') {
+            Dual& x = vals.back();
+            switch (p->ch) {
+            case 's': x = dualSin(x); continue;
+            case 'c': x = dualCos(x); continue;
+            case 't': x = dualTan(x); continue;
+            case 'l': if (!dualLn(x, err)) return false; continue;
+            default:
+                if (err) *err = "δ֪ڵ";
+                return false;
+            }
+        }
+
+        Dual y = vals.back();
+        vals.pop_back();
+        Dual& x = vals.back();
+        switch (p->ch) {
+        case '+': x = dualAdd(x, y); break;
+        case '-': x = dualSub(x, y); break;
+        case '*': x = dualMul(x, y); break;
+        case '/': if (!dualDiv(x, y, err)) return false; break;
+        case '^': x = dualPow(x, y); break;
+        default:
+            if (err) *err = string("δ֪: ") + p->ch;
+            return false;
+        }
+    }
+
+    value = vals.back().v;
+    deriv = vals.back().d;
+    return true;
+}
+
+// ڱֵֽƫֵʱʹã compileCse
+// slots Ϊ۵ֵ CompiledExpr::slotVarsvarSlot Ϊ󵼱Ĳλ
+// ʽñʱ -1Ϊ 0
+inline bool evalDual(const CompiledExpr& C, const double* slots, int varSlot, Dual& out, string* err) {
+    if (C.code.empty()) { if (err) *err = "ձʽ"; return false; }
+
+    Dual small[64];
+    vector<Dual> big;
+    Dual* stack = small;
+    if (C.maxStack + C.numRegs > 64) {
+        big.resize(C.maxStack + C.numRegs);
+        stack = big.data();
+    }
+    Dual* regs = stack + C.maxStack;
+
+    int top = -1;
+    for (const Instr& in : C.code) {
+        switch (in.op) {
+        case OP_CONST: stack[++top] = { C.consts[in.arg], 0 }; break;
+        case OP_VAR: stack[++top] = { slots[in.arg], (int)in.arg == varSlot ? 1.0 : 0.0 }; break;
+        case OP_ADD: --top; stack[top] = dualAdd(stack[top], stack[top + 1]); break;
+        case OP_SUB: --top; stack[top] = dualSub(stack[top], stack[top + 1]); break;
+        case OP_MUL: --top; stack[top] = dualMul(stack[top], stack[top + 1]); break;
+        case OP_DIV: --top; if (!dualDiv(stack[top], stack[top + 1], err)) return false; break;
+        case OP_POW: --top; stack[top] = dualPow(stack[top], stack[top + 1]); break;
+        case OP_SIN: stack[top] = dualSin(stack[top]); break;
+        case OP_COS: stack[top] = dualCos(stack[top]); break;
+        case OP_TAN: stack[top] = dualTan(stack[top]); break;
+        case OP_LN: if (!dualLn(stack[top], err)) return false; break;
+        case OP_STORE: regs[in.arg] = stack[top]; break;
+        case OP_LOAD: stack[++top] = regs[in.arg]; break;
+        default:
+            if (err) *err = C.failMsgs[in.arg];
+            return false;
+        }
+    }
+    out = stack[0];
+    return true;
+}
+
+// ===================== ģʽԶ΢֣ݶȴ =====================
+
+// һǰֵÿָĽڴϣһηɨۼӰֵ
+// õֵͶȫƫʱһֵͬף޹أ
+// Ľṹֻȡֽ룬 build һɣ֮ÿֻдֵٷڴ
+class GradientTape {
+public:
+    // ɱֽɴ compileCseĴȡֱͬһϵĽ
+    void build(const CompiledExpr& C) {
+        ops.clear();
+        failMsgs.clear();
+        slotVars = C.slotVars;
+        vector<int> st, regs((size_t)C.numRegs, -1);
+        for (const Instr& in : C.code) {
+            Op o = { in.op, -1, -1, in.arg, 0.0, false };
+            switch (in.op) {
+            case OP_CONST: o.c = C.consts[in.arg]; break;
+            case OP_VAR: o.varies = true; break;
+            case OP_STORE: regs[in.arg] = st.back(); continue;
+            case OP_LOAD: st.push_back(regs[in.arg]); continue;
+            case OP_FAIL: failMsgs.push_back(C.failMsgs[in.arg]); o.arg = (unsigned)failMsgs.size() - 1; break;
+            case OP_SIN: case OP_COS: case OP_TAN: case OP_LN:
+                o.a = st.back();
+                st.pop_back();
+                o.varies = ops[o.a].varies;
+                break;
+            default:
+                o.b = st.back();
+                st.pop_back();
+                o.a = st.back();
+                st.pop_back();
+                o.varies = ops[o.a].varies || ops[o.b].varies;
+                break;
+            }
+            st.push_back((int)ops.size());
+            ops.push_back(o);
+        }
+        result = st.empty() ? -1 : st.back();
+        vals.assign(ops.size(), 0.0);
+        adj.assign(ops.size(), 0.0);
+    }
+
+    bool empty() const { return result < 0; }
+
+    //  -> ɴ CompiledExpr::slotVars ͬ
+    const vector<char>& vars() const { return slotVars; }
+
+    // slots Ϊ۵ֵɹʱ value Ϊʽֵgrad[slot] ΪԸñƫ
+    //  eval һ£ݵĵ <= 0 ʱָƫ޶壬ָƫΪ NaNǰģʽͬ
+    bool gradient(const double* slots, double& value, double* grad, string* err) {
+        unsigned char code;
+        if (!forward(slots, code, err)) return false;
+        value = vals[result];
+        backward(grad);
+        return true;
+    }
+
+    // ݶȣ i б slot ֵΪ cols[slot][i] evalBatch ͬİв֣
+    // values[i] Ϊֵgrads[slot][i] Ϊƫĵд NaNstatus ǿʱдÿ LaneStatus
+    void gradientBatch(const double* const* cols, size_t n, double* values, double* const* grads,
+        unsigned char* status) {
+        const double nan = std::numeric_limits<double>::quiet_NaN();
+        size_t slots = slotVars.size();
+        vector<double> point(slots), g(slots);   // 
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t s = 0; s < slots; ++s) point[s] = cols[s][i];
+            unsigned char code;
+            if (forward(point.data(), code, nullptr)) {
+                values[i] = vals[result];
+                backward(g.data());
+                for (size_t s = 0; s < slots; ++s) grads[s][i] = g[s];
+            }
+            else {
+                values[i] = nan;
+                for (size_t s = 0; s < slots; ++s) grads[s][i] = nan;
+            }
+            if (status) status[i] = code;
+        }
+    }
+
+private:
+    struct Op {
+        unsigned char op;
+        int a, b;       // ڴϵλ
+        unsigned arg;   // /Ϣ±
+        double c;       // 
+        bool varies;    // ǷӱʽҪֵ
+    };
+
+    vector<Op> ops;
+    vector<char> slotVars;
+    vector<string> failMsgs;
+    vector<double> vals, adj;
+    int result = -1;   // ʽֵڴϵλ
+
+    // ǰֵ¼ÿʱ code ΪӦ LaneStatus
+    bool forward(const double* slots, unsigned char& code, string* err) {
+        if (result < 0) { code = LANE_FAIL; if (err) *err = "ձʽ"; return false; }
+        for (size_t i = 0; i < ops.size(); ++i) {
+            const Op& o = ops[i];
+            double x = o.a >= 0 ? vals[o.a] : 0, y = o.b >= 0 ? vals[o.b] : 0;
+            double& r = vals[i];
+            switch (o.op) {
+            case OP_CONST: r = o.c; break;
+            case OP_VAR: r = slots[o.arg]; break;
+            case OP_ADD: r = x + y; break;
+            case OP_SUB: r = x - y; break;
+            case OP_MUL: r = x * y; break;
+            case OP_DIV:
+                if (std::fabs(y) < 1e-12) { code = LANE_DIV_ZERO; if (err) *err = ""; return false; }
+                r = x / y;
+                break;
+            case OP_POW: r = std::pow(x, y); break;
+            case OP_SIN: r = std::sin(x); break;
+            case OP_COS: r = std::cos(x); break;
+            case OP_TAN: r = std::tan(x); break;
+            case OP_LN:
+                if (x <= 0) { code = LANE_LN_DOMAIN; if (err) *err = "ln  > 0"; return false; }
+                r = std::log(x);
+                break;
+            default:
+                code = LANE_FAIL;
+                if (err) *err = failMsgs[o.arg];
+                return false;
+            }
+        }
+        code = LANE_OK;
+        return true;
+    }
+
+    // ۼӰֵgrad[slot] ΪԱ slot ƫ
+    void backward(double* grad) {
+        for (size_t s = 0; s < slotVars.size(); ++s) grad[s] = 0;
+        std::fill(adj.begin(), adj.end(), 0.0);
+        adj[result] = 1;
+        for (size_t i = ops.size(); i-- > 0;) {
+            const Op& o = ops[i];
+            double g = adj[i];
+            if (!o.varies) continue;
+            double x = o.a >= 0 ? vals[o.a] : 0, y = o.b >= 0 ? vals[o.b] : 0;
+            switch (o.op) {
+            case OP_VAR: grad[o.arg] += g; break;
+            case OP_ADD: adj[o.a] += g; adj[o.b] += g; break;
+            case OP_SUB: adj[o.a] += g; adj[o.b] -= g; break;
+            case OP_MUL: adj[o.a] += g * y; adj[o.b] += g * x; break;
+            case OP_DIV:
+                adj[o.a] += g / y;
+                adj[o.b] -= g * x / (y * y);
+                break;
+            case OP_POW:
+                // d/du = v*u^(v-1)d/dv = u^v*ln(u)u <= 0 ʱ޶壬ֻþָƫΪ NaN
+                if (ops[o.a].varies && y != 0) adj[o.a] += g * y * std::pow(x, y - 1);
+                if (ops[o.b].varies)
+                    adj[o.b] += x > 0 ? g * vals[i] * std::log(x) : std::numeric_limits<double>::quiet_NaN();
+                break;
+            case OP_SIN: adj[o.a] += g * std::cos(x); break;
+            case OP_COS: adj[o.a] -= g * std::sin(x); break;
+            case OP_TAN: {
+                double c = std::cos(x);
+                adj[o.a] += g / (c * c);
+                break;
+            }
+            case OP_LN: adj[o.a] += g / x; break;
+            default: break;
+            }
+        }
+    }
+};
+
+// ݽӿڣȫֵgrad Ϊ collectVars() ÿƫ
+inline bool evalGradient(const ExprTree& T, const std::map<char, double>& vars, double& value,
+    std::map<char, double>& grad, string* err) {
+    CompiledExpr C;
+    C.compile(T);
+
+    vector<double> point;
+    if (!C.bindSlots(vars, point, err)) return false;
+    GradientTape tape;
+    tape.build(C);
+    vector<double> g(C.slotVars.size());
+    if (!tape.gradient(point.data(), value, g.data(), err)) return false;
+    grad.clear();
+    for (size_t i = 0; i < C.slotVars.size(); ++i) grad[C.slotVars[i]] = g[i];
+    return true;
+}
+
+#endif // PPE_AUTODIFF_H
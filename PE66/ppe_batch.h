@@ -0,0 +1,228 @@
+#ifndef PPE_BATCH_H
+#define PPE_BATCH_H
+
+#include "ppe_compile.h"
+
+#include <limits>
+
+#if defined(__AVX2__) || defined(__AVX__)
+#include <immintrin.h>
+#define PPE_SIMD_AVX 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PPE_SIMD_SSE2 1
+#endif
+
+// ===================== Уֵ =====================
+
+// ÿһеֵ״̬¼ĵһ ExprTree::eval ı˳һ£
+enum LaneStatus : unsigned char {
+    LANE_OK = 0,         // ֵɹ
+    LANE_DIV_ZERO = 1,   // 
+    LANE_LN_DOMAIN = 2,  // ln  > 0
+    LANE_FAIL = 3,       // սڵ/δ֪Ƚṹ
+};
+
+// ÿദ
+const size_t BATCH_BLOCK = 256;
+// ĴջԤ㣨double ջʱԶСÿ
+const size_t BATCH_REG_BUDGET = 1 << 16;
+
+// ֻڸ޴ʱ¼
+inline void markLane(unsigned char* st, size_t i, unsigned char code) {
+    if (st[i] == LANE_OK) st[i] = code;
+}
+
+// ---------- ںˣa[i] = a[i] op b[i] ----------
+
+inline void batchAdd(double* a, const double* b, size_t n) {
+    size_t i = 0;
+#if defined(PPE_SIMD_AVX)
+    for (; i + 4 <= n; i += 4)
+        _mm256_storeu_pd(a + i, _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+#elif defined(PPE_SIMD_SSE2)
+    for (; i + 2 <= n; i += 2)
+        _mm_storeu_pd(a + i, _mm_add_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+#endif
+    for (; i < n; ++i) a[i] = a[i] + b[i];
+}
+
+inline void batchSub(double* a, const double* b, size_t n) {
+    size_t i = 0;
+#if defined(PPE_SIMD_AVX)
+    for (; i + 4 <= n; i += 4)
+        _mm256_storeu_pd(a + i, _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+#elif defined(PPE_SIMD_SSE2)
+    for (; i + 2 <= n; i += 2)
+        _mm_storeu_pd(a + i, _mm_sub_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+#endif
+    for (; i < n; ++i) a[i] = a[i] - b[i];
+}
+
+inline void batchMul(double* a, const double* b, size_t n) {
+    size_t i = 0;
+#if defined(PPE_SIMD_AVX)
+    for (; i + 4 <= n; i += 4)
+        _mm256_storeu_pd(a + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+#elif defined(PPE_SIMD_SSE2)
+    for (; i + 2 <= n; i += 2)
+        _mm_storeu_pd(a + i, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+#endif
+    for (; i < n; ++i) a[i] = a[i] * b[i];
+}
+
+// |b| < 1e-12 мΪ
+inline void batchDiv(double* a, const double* b, size_t n, unsigned char* st) {
+    size_t i = 0;
+#if defined(PPE_SIMD_AVX)
+    const __m256d absMask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffLL));
+    const __m256d eps = _mm256_set1_pd(1e-12);
+    for (; i + 4 <= n; i += 4) {
+        __m256d vb = _mm256_loadu_pd(b + i);
+        int m = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_and_pd(vb, absMask), eps, _CMP_LT_OQ));
+        if (m) for (int k = 0; k < 4; ++k) if (m & (1 << k)) markLane(st, i + k, LANE_DIV_ZERO);
+        _mm256_storeu_pd(a + i, _mm256_div_pd(_mm256_loadu_pd(a + i), vb));
+    }
+#elif defined(PPE_SIMD_SSE2)
+    const __m128d absMask = _mm_castsi128_pd(_mm_set1_epi64x(0x7fffffffffffffffLL));
+    const __m128d eps = _mm_set1_pd(1e-12);
+    for (; i + 2 <= n; i += 2) {
+        __m128d vb = _mm_loadu_pd(b + i);
+        int m = _mm_movemask_pd(_mm_cmplt_pd(_mm_and_pd(vb, absMask), eps));
+        if (m & 1) markLane(st, i, LANE_DIV_ZERO);
+        if (m & 2) markLane(st, i + 1, LANE_DIV_ZERO);
+        _mm_storeu_pd(a + i, _mm_div_pd(_mm_loadu_pd(a + i), vb));
+    }
+#endif
+    for (; i < n; ++i) {
+        if (std::fabs(b[i]) < 1e-12) markLane(st, i, LANE_DIV_ZERO);
+        a[i] = a[i] / b[i];
+    }
+}
+
+// ln 飺x <= 0 мǴ
+inline void batchLnCheck(const double* a, size_t n, unsigned char* st) {
+    size_t i = 0;
+#if defined(PPE_SIMD_AVX)
+    const __m256d zero = _mm256_setzero_pd();
+    for (; i + 4 <= n; i += 4) {
+        int m = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(a + i), zero, _CMP_LE_OQ));
+        if (m) for (int k = 0; k < 4; ++k) if (m & (1 << k)) markLane(st, i + k, LANE_LN_DOMAIN);
+    }
+#elif defined(PPE_SIMD_SSE2)
+    const __m128d zero = _mm_setzero_pd();
+    for (; i + 2 <= n; i += 2) {
+        int m = _mm_movemask_pd(_mm_cmple_pd(_mm_loadu_pd(a + i), zero));
+        if (m & 1) markLane(st, i, LANE_LN_DOMAIN);
+        if (m & 2) markLane(st, i + 1, LANE_LN_DOMAIN);
+    }
+#endif
+    for (; i < n; ++i)
+        if (a[i] <= 0) markLane(st, i, LANE_LN_DOMAIN);
+}
+
+// ԽԪصñ׼⣨ eval λһ£
+// ѭ޷֧MSVC /O2 ȱɽѧԶ
+inline void batchPow(double* a, const double* b, size_t n) {
+    for (size_t i = 0; i < n; ++i) a[i] = std::pow(a[i], b[i]);
+}
+inline void batchSin(double* a, size_t n) {
+    for (size_t i = 0; i < n; ++i) a[i] = std::sin(a[i]);
+}
+inline void batchCos(double* a, size_t n) {
+    for (size_t i = 0; i < n; ++i) a[i] = std::cos(a[i]);
+}
+inline void batchTan(double* a, size_t n) {
+    for (size_t i = 0; i < n; ++i) a[i] = std::tan(a[i]);
+}
+inline void batchLog(double* a, size_t n) {
+    for (size_t i = 0; i < n; ++i) a[i] = std::log(a[i]);
+}
+
+// ---------- ֵ ----------
+
+//  n ֵcols[slot] ָ slot CompiledExpr::slotVars n ֵ
+// д out[0..n)д NaNstatus ǿʱдÿе LaneStatus
+inline void evalBatch(const CompiledExpr& C, const double* const* cols, size_t n,
+    double* out, unsigned char* status) {
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    if (C.empty()) {
+        for (size_t i = 0; i < n; ++i) out[i] = nan;
+        if (status) for (size_t i = 0; i < n; ++i) status[i] = LANE_FAIL;
+        return;
+    }
+
+    // ÿ֤ (maxStack + numRegs) * block Ԥ
+    size_t depth = (size_t)(std::max)(C.maxStack, 1);
+    size_t block = BATCH_REG_BUDGET / (depth + C.numRegs);
+    if (block > BATCH_BLOCK) block = BATCH_BLOCK;
+    if (block < 4) block = 4;
+
+    vector<double> regs((depth + C.numRegs) * block);  // ջǰӱʽĴں
+    unsigned char st[BATCH_BLOCK];
+
+    for (size_t base = 0; base < n; base += block) {
+        size_t len = (std::min)(block, n - base);
+        std::memset(st, LANE_OK, len);
+
+        int top = -1;
+        auto reg = [&](int k) { return regs.data() + (size_t)k * block; };
+
+        bool aborted = false;
+        for (const Instr& in : C.code) {
+            if (aborted) break;
+            switch (in.op) {
+            case OP_CONST: {
+                double* r = reg(++top);
+                double v = C.consts[in.arg];
+                for (size_t i = 0; i < len; ++i) r[i] = v;
+                break;
+            }
+            case OP_VAR:
+                std::memcpy(reg(++top), cols[in.arg] + base, len * sizeof(double));
+                break;
+            case OP_ADD: --top; batchAdd(reg(top), reg(top + 1), len); break;
+            case OP_SUB: --top; batchSub(reg(top), reg(top + 1), len); break;
+            case OP_MUL: --top; batchMul(reg(top), reg(top + 1), len); break;
+            case OP_DIV: --top; batchDiv(reg(top), reg(top + 1), len, st); break;
+            case OP_POW: --top; batchPow(reg(top), reg(top + 1), len); break;
+            case OP_SIN: batchSin(reg(top), len); break;
+            case OP_COS: batchCos(reg(top), len); break;
+            case OP_TAN: batchTan(reg(top), len); break;
+            case OP_LN:
+                batchLnCheck(reg(top), len, st);
+                batchLog(reg(top), len);
+                break;
+            case OP_STORE:
+                std::memcpy(reg((int)(depth + in.arg)), reg(top), len * sizeof(double));
+                break;
+            case OP_LOAD:
+                std::memcpy(reg(++top), reg((int)(depth + in.arg)), len * sizeof(double));
+                break;
+            default:
+                // ṹж˺ÿжд󣬲ؼִ
+                for (size_t i = 0; i < len; ++i) markLane(st, i, LANE_FAIL);
+                aborted = true;
+                break;
+            }
+        }
+
+        const double* r = reg(0);
+        for (size_t i = 0; i < len; ++i) out[base + i] = (st[i] == LANE_OK) ? r[i] : nan;
+        if (status) std::memcpy(status + base, st, len);
+    }
+}
+
+// ݽӿڣṩУȱĳʱ false
+inline bool evalBatch(const ExprTree& T, const std::map<char, const double*>& cols, size_t n,
+    double* out, unsigned char* status, string* err) {
+    CompiledExpr C;
+    C.compile(T);
+
+    vector<const double*> slotCols;
+    if (!C.bindSlots(cols, slotCols, err)) return false;
+    evalBatch(C, slotCols.data(), n, out, status);
+    return true;
+}
+
+#endif // PPE_BATCH_H
@@ -0,0 +1,420 @@
+#ifndef PPE_COMPILE_H
+#define PPE_COMPILE_H
+
+#include "ppe.h"
+#include "ppe_dag.h"
+
+#include <unordered_map>
+#include <cstring>
+#include <cstdint>
+
+// ===================== ıʽԺ׺ֽ룩 =====================
+
+// ָ
+enum OpCode : unsigned char {
+    OP_CONST,   // ѹ볣 consts[arg]
+    OP_VAR,     // ѹ arg ֵ
+    OP_ADD,     // Ԫ㣺 yxѹ x op y
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_POW,
+    OP_SIN,     // һԪ xѹ f(x)
+    OP_COS,
+    OP_TAN,
+    OP_LN,
+    OP_FAIL,    //  failMsgs[arg] ֹӦϵĿսڵ/δ֪
+    OP_STORE,   // ջֵƵĴ argջ OP_LOAD 
+    OP_LOAD,    // ѹĴ arg ֵ
+};
+
+// ָ
+struct Instr {
+    unsigned char op;   // 
+    unsigned arg;       // ±//Ϣ±
+};
+
+// Ԫת룬Ƿ OP_FAIL
+inline unsigned char opCodeFromOp(char c) {
+    switch (c) {
+    case '+': return OP_ADD;
+    case '-': return OP_SUB;
+    case '*': return OP_MUL;
+    case '/': return OP_DIV;
+    case '^': return OP_POW;
+    default:  return OP_FAIL;
+    }
+}
+
+// ת룬Ƿ OP_FAIL
+inline unsigned char opCodeFromFunc(char c) {
+    switch (c) {
+    case 's': return OP_SIN;
+    case 'c': return OP_COS;
+    case 't': return OP_TAN;
+    case 'l': return OP_LN;
+    default:  return OP_FAIL;
+    }
+}
+
+// ӱʽͳ
+struct CseReport {
+    size_t treeNodes = 0;    // չĽڵ
+    size_t uniqueNodes = 0;  // ȥغͬӱʽĸ
+    size_t dedupNodes = 0;   // ʡĽڵtreeNodes - uniqueNodes
+    size_t sharedExprs = 0;  // ദáֻһεӱʽ
+    int registers = 0;       // õļĴ꼴ոã
+};
+
+// ѱʽһΣ֮ڽյջѭзֵ
+//  ExprTree::eval ȫһ£㡢ln δֵȴȺ˳
+struct CompiledExpr {
+    vector<Instr> code;        // ָУ׺˳
+    vector<double> consts;     // 
+    vector<char> slotVars;     //  -> 
+    vector<string> failMsgs;   // OP_FAIL ʹõĴϢ
+    int maxStack = 0;          // ֵջ
+    int numRegs = 0;           // ӱʽĴ compileCse ɣ
+
+    bool empty() const { return code.empty(); }
+
+    void clear() {
+        code.clear();
+        consts.clear();
+        slotVars.clear();
+        failMsgs.clear();
+        maxStack = 0;
+        numRegs = 0;
+    }
+
+    // ӦĲλڷ -1
+    int slotOf(char v) const {
+        for (int i = 0; i < (int)slotVars.size(); ++i)
+            if (slotVars[i] == v) return i;
+        return -1;
+    }
+
+    // ȡ۵ֵout[slot] = vars[slotVars[slot]]ȱĳָΪգʱ false
+    // evalBatchevalBatchParallelevalIntervalevalGradient İݽӿڶ
+    template <class T>
+    bool bindSlots(const std::map<char, T>& vars, vector<T>& out, string* err) const {
+        out.resize(slotVars.size());
+        for (size_t i = 0; i < slotVars.size(); ++i) {
+            auto it = vars.find(slotVars[i]);
+            if (it == vars.end() || !slotBound(it->second)) {
+                if (err) *err = "δֵ: " + varNameFromCode(slotVars[i]);
+                return false;
+            }
+            out[i] = it->second;
+        }
+        return true;
+    }
+
+    // ʽ
+    void compile(const ExprTree& T) {
+        compile(T.root);
+    }
+
+    //  root Ϊʽջƣ
+    // 뱾ʧܣսڵ㡢δֵ֪ʱűĴΪ OP_FAIL ָ
+    // ִеʱͬĴȺ˳ֵһ£
+    void compile(Node* root) {
+        clear();
+
+        std::unordered_map<uint64_t, unsigned> constIdx;  // ȥأλģʽ
+        struct Frame { Node* p; bool expanded; };
+        vector<Frame> st;
+        st.push_back({ root, false });
+        int depth = 0;
+
+        auto emit = [&](unsigned char op, unsigned arg) { code.push_back({ op, arg }); };
+        auto fail = [&](const string& msg) {
+            failMsgs.push_back(msg);
+            emit(OP_FAIL, (unsigned)failMsgs.size() - 1);
+        };
+
+        while (!st.empty()) {
+            Frame f = st.back();
+            st.pop_back();
+            Node* p = f.p;
+
+            if (!p) {
+                fail("սڵ");
+                ++depth;
+            }
+            else if (p->kind == 'N') {
+                uint64_t bits;
+                std::memcpy(&bits, &p->num, sizeof(bits));
+                auto it = constIdx.find(bits);
+                if (it == constIdx.end()) {
+                    it = constIdx.emplace(bits, (unsigned)consts.size()).first;
+                    consts.push_back(p->num);
+                }
+                emit(OP_CONST, it->second);
+                ++depth;
+            }
+            else if (p->kind == 'V') {
+                int slot = slotOf(p->ch);
+                if (slot < 0) {
+                    slot = (int)slotVars.size();
+                    slotVars.push_back(p->ch);
+                }
+                emit(OP_VAR, (unsigned)slot);
+                ++depth;
+            }
+            else if (!f.expanded) {
+                // ѹӽڵ㴦ٷָٰҡ˳ѹӽڵ
+                st.push_back({ p, true });
+                if (p->kind != 'F') st.push_back({ p->r, false });
+                st.push_back({ p->l, false });
+            }
+            else if (p->kind == 'F') {
+                unsigned char op = opCodeFromFunc(p->ch);
+                if (op == OP_FAIL) fail("δ֪ڵ");
+                else emit(op, 0);
+            }
+            else {
+                unsigned char op = opCodeFromOp(p->ch);
+                if (op == OP_FAIL) fail(string("δ֪: ") + p->ch);
+                else emit(op, 0);
+                --depth;
+            }
+            if (depth > maxStack) maxStack = depth;
+        }
+    }
+
+    // ӱʽı룺ṹֻͬһΣĴ
+    // ÿӱʽһγֵλԭ˳ͬ˽뱨˳ compile ȫһ
+    //  compile ͬ뱾ʧ
+    void compileCse(const ExprTree& T, CseReport* report) {
+        compileCse(T.root, report);
+    }
+
+    void compileCse(Node* root, CseReport* report);
+
+    // ˳ȫֵֵ
+    bool run(const double* slots, double& out, string* err) const {
+        return runImpl<false>(slots, nullptr, out, err);
+    }
+
+    //  ExprTree::eval ͬĽӿڣδֵıִеʱ
+    bool eval(const std::map<char, double>& vars, double& out, string* err) const {
+        double small[16];
+        unsigned char smallPresent[16];
+        vector<double> big;
+        vector<unsigned char> bigPresent;
+        double* vals = small;
+        unsigned char* present = smallPresent;
+        if (slotVars.size() > 16) {
+            big.resize(slotVars.size());
+            bigPresent.resize(slotVars.size());
+            vals = big.data();
+            present = bigPresent.data();
+        }
+
+        bool all = true;
+        for (size_t i = 0; i < slotVars.size(); ++i) {
+            auto it = vars.find(slotVars[i]);
+            present[i] = (it != vars.end());
+            vals[i] = present[i] ? it->second : 0.0;
+            if (!present[i]) all = false;
+        }
+        if (all) return runImpl<false>(vals, nullptr, out, err);
+        return runImpl<true>(vals, present, out, err);
+    }
+
+private:
+    template <class T>
+    static bool slotBound(const T&) { return true; }
+    static bool slotBound(const double* col) { return col != nullptr; }
+
+    // ջѭChecked Ϊ true ʱڶȡʱǷѸֵ
+    template <bool Checked>
+    bool runImpl(const double* slots, const unsigned char* present, double& out, string* err) const {
+        if (code.empty()) { if (err) *err = "ձʽ"; return false; }
+
+        double small[64];
+        vector<double> big;
+        double* stack = small;
+        if (maxStack + numRegs > 64) {
+            big.resize(maxStack + numRegs);
+            stack = big.data();
+        }
+        double* regs = stack + maxStack;  // Ĵջ֮
+
+        int top = -1;
+        for (const Instr& in : code) {
+            switch (in.op) {
+            case OP_CONST:
+                stack[++top] = consts[in.arg];
+                break;
+            case OP_VAR:
+                if (Checked && !present[in.arg]) {
+                    if (err) *err = "δֵ: " + varNameFromCode(slotVars[in.arg]);
+                    return false;
+                }
+                stack[++top] = slots[in.arg];
+                break;
+            case OP_ADD: --top; stack[top] = stack[top] + stack[top + 1]; break;
+            case OP_SUB: --top; stack[top] = stack[top] - stack[top + 1]; break;
+            case OP_MUL: --top; stack[top] = stack[top] * stack[top + 1]; break;
+            case OP_DIV:
+                --top;
+                if (std::fabs(stack[top + 1]) < 1e-12) { if (err) *err = ""; return false; }
+                stack[top] = stack[top] / stack[top + 1];
+                break;
+            case OP_POW: --top; stack[top] = std::pow(stack[top], stack[top + 1]); break;
+            case OP_SIN: stack[top] = std::sin(stack[top]); break;
+            case OP_COS: stack[top] = std::cos(stack[top]); break;
+            case OP_TAN: stack[top] = std::tan(stack[top]); break;
+            case OP_LN:
+                if (stack[top] <= 0) { if (err) *err = "ln  > 0"; return false; }
+                stack[top] = std::log(stack[top]);
+                break;
+            case OP_STORE: regs[in.arg] = stack[top]; break;
+            case OP_LOAD: stack[++top] = regs[in.arg]; break;
+            default:
+                if (err) *err = failMsgs[in.arg];
+                return false;
+            }
+        }
+        out = stack[0];
+        return true;
+    }
+};
+
+inline void CompiledExpr::compileCse(Node* root, CseReport* report) {
+    clear();
+
+    DagStore S(false);   // -0  0 ϲ(-0)^(-1)  0^(-1) ͬ
+    Node* dag = S.intern(root);
+
+    // ͳÿ DAG ڵ㱻õĴÿڵֻչһΣ԰߼ɣ
+    std::unordered_map<Node*, int> refs;
+    {
+        vector<Node*> st;
+        if (dag) { st.push_back(dag); refs[dag] = 1; }
+        while (!st.empty()) {
+            Node* p = st.back();
+            st.pop_back();
+            Node* kids[2] = { p->l, p->kind == 'O' ? p->r : nullptr };
+            for (Node* c : kids) {
+                if (!c) continue;
+                if (refs[c]++ == 0) st.push_back(c);
+            }
+        }
+    }
+
+    std::unordered_map<uint64_t, unsigned> constIdx;
+    std::unordered_map<Node*, int> regOf;    // Ѽ㲢ĴĽڵ
+    std::unordered_map<Node*, int> pending;  // ʣδȡô
+    vector<int> freeRegs;
+    size_t shared = 0;
+
+    struct Frame { Node* p; bool expanded; };
+    vector<Frame> st;
+    st.push_back({ dag, false });
+    int depth = 0;
+
+    auto emit = [&](unsigned char op, unsigned arg) { code.push_back({ op, arg }); };
+    auto fail = [&](const string& msg) {
+        failMsgs.push_back(msg);
+        emit(OP_FAIL, (unsigned)failMsgs.size() - 1);
+    };
+
+    while (!st.empty()) {
+        Frame f = st.back();
+        st.pop_back();
+        Node* p = f.p;
+
+        if (!p) {
+            fail("սڵ");
+            ++depth;
+        }
+        else if (p->kind == 'N') {
+            uint64_t bits;
+            std::memcpy(&bits, &p->num, sizeof(bits));
+            auto it = constIdx.find(bits);
+            if (it == constIdx.end()) {
+                it = constIdx.emplace(bits, (unsigned)consts.size()).first;
+                consts.push_back(p->num);
+            }
+            emit(OP_CONST, it->second);
+            ++depth;
+        }
+        else if (p->kind == 'V') {
+            int slot = slotOf(p->ch);
+            if (slot < 0) {
+                slot = (int)slotVars.size();
+                slotVars.push_back(p->ch);
+            }
+            emit(OP_VAR, (unsigned)slot);
+            ++depth;
+        }
+        else if (!f.expanded) {
+            auto it = regOf.find(p);
+            if (it != regOf.end()) {
+                // ѼֱӶĴһζȡռĴ
+                emit(OP_LOAD, (unsigned)it->second);
+                ++depth;
+                if (--pending[p] == 0) {
+                    freeRegs.push_back(it->second);
+                    regOf.erase(it);
+                }
+            }
+            else {
+                st.push_back({ p, true });
+                if (p->kind != 'F') st.push_back({ p->r, false });
+                st.push_back({ p->l, false });
+            }
+        }
+        else {
+            if (p->kind == 'F') {
+                unsigned char op = opCodeFromFunc(p->ch);
+                if (op == OP_FAIL) fail("δ֪ڵ");
+                else emit(op, 0);
+            }
+            else {
+                unsigned char op = opCodeFromOp(p->ch);
+                if (op == OP_FAIL) fail(string("δ֪: ") + p->ch);
+                else emit(op, 0);
+                --depth;
+            }
+            int n = refs[p];
+            if (n > 1) {
+                int reg;
+                if (!freeRegs.empty()) { reg = freeRegs.back(); freeRegs.pop_back(); }
+                else reg = numRegs++;
+                emit(OP_STORE, (unsigned)reg);
+                regOf[p] = reg;
+                pending[p] = n - 1;
+                ++shared;
+            }
+        }
+        if (depth > maxStack) maxStack = depth;
+    }
+
+    if (report) {
+        report->treeNodes = (size_t)dagTreeSize(dag);
+        report->uniqueNodes = dagNodeCount(dag);
+        report->dedupNodes = report->treeNodes - report->uniqueNodes;
+        report->sharedExprs = shared;
+        report->registers = numRegs;
+    }
+}
+
+// ʽıݺ
+inline CompiledExpr CompileExpr(const ExprTree& T) {
+    CompiledExpr C;
+    C.compile(T);
+    return C;
+}
+
+// ӱʽıݺ
+inline CompiledExpr CompileExprCse(const ExprTree& T, CseReport* report) {
+    CompiledExpr C;
+    C.compileCse(T, report);
+    return C;
+}
+
+#endif // PPE_COMPILE_H
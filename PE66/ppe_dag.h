@@ -0,0 +1,860 @@
+#ifndef PPE_DAG_H
+#define PPE_DAG_H
+
+#include "ppe.h"
+
+#include <unordered_map>
+#include <unordered_set>
+#include <cstring>
+#include <cstdint>
+
+// ӱʽ DAGڵֿ DagStoreԼ DAG ֱֵdagEvalƫdagDerivativedagSimplify
+// ǿӿڣʱ벻ͬӱʽĸȣǶĳֱӵãо GradientTree
+// MixedPartialTreeHessianTree ʹǣͼν治ʹátests/test_core.cpp ϵ evalderivNodesimplify 
+
+// ===================== ӱʽĽڵֿ⣨hash-consing =====================
+
+// ֿнṹֻͬһݣʽΪ DAGڵ㴴޸ģɱڵ㹲
+// λȽϣͬһֿڡṹͬȼڡָͬĬϰ -0 ͳһ 0Żжͬ
+// Ҫֵλʱ compileCseʱ mergeSignedZero = false
+// ڵȫڲֿԼ arena Уֿһգǵ freeTree ͷκζ
+class DagStore {
+public:
+    explicit DagStore(bool mergeSignedZero = true) : mergeZero(mergeSignedZero) {}
+    DagStore(const DagStore&) = delete;
+    DagStore& operator=(const DagStore&) = delete;
+
+    Node* num(double v) {
+        if (v == 0 && mergeZero) v = 0.0;  // ͳһ -0
+        uint64_t bits;
+        std::memcpy(&bits, &v, sizeof(bits));
+        return get('N', 0, bits, v, nullptr, nullptr);
+    }
+    Node* var(char c) { return get('V', c, 0, 0, nullptr, nullptr); }
+    Node* op(char op, Node* l, Node* r) { return get('O', op, 0, 0, l, r); }
+    Node* func(char code, Node* l) { return get('F', code, 0, 0, l, nullptr); }
+    Node* func(const std::string& name, Node* l) { return func(funcCodeFromName(name), l); }
+
+    // һֿͨе DAG뱾ֿ⣬عĸ
+    Node* intern(Node* root) {
+        if (!root) return nullptr;
+        std::unordered_map<Node*, Node*> memo;
+        vector<std::pair<Node*, bool>> st;
+        st.push_back({ root, false });
+        auto get = [&](Node* c) { return c ? memo[c] : nullptr; };
+
+        while (!st.empty()) {
+            Node* p = st.back().first;
+            bool expanded = st.back().second;
+            st.pop_back();
+            if (memo.count(p)) continue;
+
+            if (!expanded && (p->kind == 'O' || p->kind == 'F')) {
+                st.push_back({ p, true });
+                if (p->kind == 'O' && p->r) st.push_back({ p->r, false });
+                if (p->l) st.push_back({ p->l, false });
+                continue;
+            }
+            switch (p->kind) {
+            case 'N': memo[p] = num(p->num); break;
+            case 'V': memo[p] = var(p->ch); break;
+            case 'F': memo[p] = func(p->ch, get(p->l)); break;
+            default:  memo[p] = op(p->ch, get(p->l), get(p->r)); break;
+            }
+        }
+        return memo[root];
+    }
+
+    // ֿеĽڵͬӱʽĸ
+    size_t size() const { return table.size(); }
+
+    // ȫڵ
+    void clear() {
+        table.clear();
+        arena.reset();
+    }
+
+private:
+    struct Key {
+        uint64_t bits;  // λģʽ
+        Node* l;
+        Node* r;
+        char kind;
+        char ch;
+        bool operator==(const Key& o) const {
+            return bits == o.bits && l == o.l && r == o.r && kind == o.kind && ch == o.ch;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& k) const {
+            uint64_t h = k.bits * 0x9E3779B97F4A7C15ULL;
+            h ^= (uint64_t)(uintptr_t)k.l + 0x7F4A7C159E3779B9ULL + (h << 6) + (h >> 2);
+            h ^= (uint64_t)(uintptr_t)k.r + 0x94D049BB133111EBULL + (h << 6) + (h >> 2);
+            h ^= ((uint64_t)(unsigned char)k.kind << 8 | (unsigned char)k.ch) + (h << 6) + (h >> 2);
+            return (size_t)(h ^ (h >> 31));
+        }
+    };
+
+    // һ򴴽ڵ
+    Node* get(char kind, char ch, uint64_t bits, double v, Node* l, Node* r) {
+        Key k{ bits, l, r, kind, ch };
+        auto it = table.find(k);
+        if (it != table.end()) return it->second;
+        Node* p = arena.alloc();
+        p->kind = kind;
+        p->ch = ch;
+        p->num = v;
+        p->l = l;
+        p->r = r;
+        table.emplace(k, p);
+        return p;
+    }
+
+    bool mergeZero;
+    NodeArena arena;
+    std::unordered_map<Key, Node*, KeyHash> table;
+};
+
+// ===================== DAG ͳ =====================
+
+// ɸɴĲͬڵĽڵֻһΣ
+inline size_t dagNodeCount(const vector<Node*>& roots) {
+    std::unordered_set<Node*> seen;
+    vector<Node*> st;
+    for (Node* r : roots) if (r) st.push_back(r);
+    while (!st.empty()) {
+        Node* p = st.back();
+        st.pop_back();
+        if (!seen.insert(p).second) continue;
+        if (p->l) st.push_back(p->l);
+        if (p->r) st.push_back(p->r);
+    }
+    return seen.size();
+}
+
+// DAG пɴĲͬڵ
+inline size_t dagNodeCount(Node* root) {
+    return dagNodeCount(vector<Node*>(1, root));
+}
+
+//  DAG չĽڵܷǳ double ʾ
+inline double dagTreeSize(Node* root) {
+    std::unordered_map<Node*, double> memo;
+    vector<std::pair<Node*, bool>> st;
+    if (root) st.push_back({ root, false });
+    auto get = [&](Node* c) { return c ? memo[c] : 0.0; };
+    while (!st.empty()) {
+        Node* p = st.back().first;
+        bool expanded = st.back().second;
+        st.pop_back();
+        if (memo.count(p)) continue;
+        if (!expanded) {
+            st.push_back({ p, true });
+            if (p->r) st.push_back({ p->r, false });
+            if (p->l) st.push_back({ p->l, false });
+            continue;
+        }
+        memo[p] = 1 + get(p->l) + get(p->r);
+    }
+    return root ? memo[root] : 0.0;
+}
+
+//  treesEqual ͬеȹ򣨳 < 1e-12 Ϊȣָͬͼֱе
+inline bool dagEqual(Node* a, Node* b) {
+    vector<std::pair<Node*, Node*>> st;
+    st.push_back({ a, b });
+    while (!st.empty()) {
+        Node* x = st.back().first;
+        Node* y = st.back().second;
+        st.pop_back();
+        if (x == y) continue;
+        if (!x || !y || x->kind != y->kind) return false;
+        if (x->kind == 'N') {
+            if (std::fabs(x->num - y->num) >= 1e-12) return false;
+            continue;
+        }
+        if (x->ch != y->ch) return false;
+        if (x->kind == 'V') continue;
+        st.push_back({ x->l, y->l });
+        if (x->kind == 'O') st.push_back({ x->r, y->r });
+    }
+    return true;
+}
+
+// ===================== DAG ֵ =====================
+
+//  DAG ֵÿͬӱʽֻһΣݺȺ˳ ExprTree::eval һ
+inline bool dagEval(Node* root, const std::map<char, double>& vars, double& out, string* err) {
+    std::unordered_map<Node*, double> memo;
+    vector<std::pair<Node*, bool>> st;
+    st.push_back({ root, false });
+
+    while (!st.empty()) {
+        Node* p = st.back().first;
+        bool expanded = st.back().second;
+        st.pop_back();
+
+        if (!p) { if (err) *err = "սڵ"; return false; }
+        if (memo.count(p)) continue;
+
+        if (p->kind == 'N') { memo[p] = p->num; continue; }
+        if (p->kind == 'V') {
+            auto it = vars.find(p->ch);
+            if (it == vars.end()) {
+                if (err) *err = "δֵ: " + varNameFromCode(p->ch);
+                return false;
+            }
+            memo[p] = it->second;
+            continue;
+        }
+        if (!expanded) {
+            // ңݹֵı˳һ
+            st.push_back({ p, true });
+            if (p->kind == 'O') st.push_back({ p->r, false });
+            st.push_back({ p->l, false });
+            continue;
+        }
+
+        double x = memo[p->l];
+        double v = 0;
+        if (p->kind == 'F') {
+            switch (p->ch) {
+            case 's': v = std::sin(x); break;
+            case 'c': v = std::cos(x); break;
+            case 't': v = std::tan(x); break;
+            case 'l':
+                if (x <= 0) { if (err) *err = "ln  > 0"; return false; }
+                v = std::log(x);
+                break;
+            default:
+                if (err) *err = "δ֪ڵ";
+                return false;
+            }
+        }
+        else {
+            double y = memo[p->r];
+            switch (p->ch) {
+            case '+': v = x + y; break;
+            case '-': v = x - y; break;
+            case '*': v = x * y; break;
+            case '/':
+                if (std::fabs(y) < 1e-12) { if (err) *err = ""; return false; }
+                v = x / y;
+                break;
+            case '^': v = std::pow(x, y); break;
+            default:
+                if (err) *err = string("δ֪: ") + p->ch;
+                return false;
+            }
+        }
+        memo[p] = v;
+    }
+    out = memo[root];
+    return true;
+}
+
+// ===================== DAG ƫ =====================
+
+// ڲֿдڵ㣬 opFoldDecision ۵ makeOpFold ֿͬڵ㹲ͷűһࣩ
+inline Node* dagOpFold(DagStore& S, char op, Node* l, Node* r) {
+    double v = 0;
+    switch (opFoldDecision(op, l, r, v)) {
+    case FOLD_LEFT: return l;
+    case FOLD_RIGHT: return r;
+    case FOLD_CONST: return S.num(v);
+    default: return S.op(op, l, r);
+    }
+}
+
+// 󵼷 derivNode ͬʱ dagOpFold ۵p ӽڵ uv ĵֱΪ dudv ʱ p ĵ
+// һԪ dvdagDerivativeԼ DerivativeCache dagGradientdudv ȡ 0
+// p ӽڵǿգδ֪/ʱ nullptr
+inline Node* dagDerivRule(DagStore& S, Node* p, Node* du, Node* dv, string* err) {
+    Node* u = p->l;
+    Node* v = p->r;
+    auto isZero = [](Node* c) { double x = 0; return isNumLeaf(c, x) && std::fabs(x) < 1e-12; };
+    bool duZero = isZero(du);
+
+    if (p->kind == 'F') {
+        if (p->ch != 's' && p->ch != 'c' && p->ch != 't' && p->ch != 'l') {
+            if (err) *err = "ֵ֧ĺ";
+            return nullptr;
+        }
+        if (duZero) return du;
+        switch (p->ch) {
+        case 's': return dagOpFold(S, '*', S.func('c', u), du);
+        case 'c': return dagOpFold(S, '*', S.op('*', S.num(-1), S.func('s', u)), du);
+        case 't': return dagOpFold(S, '*', S.op('/', S.num(1), S.op('^', S.func('c', u), S.num(2))), du);
+        default:  return dagOpFold(S, '/', du, u);
+        }
+    }
+
+    bool dvZero = isZero(dv);
+    switch (p->ch) {
+    case '+':
+    case '-':
+        return dagOpFold(S, p->ch, du, dv);
+    case '*':
+        return dagOpFold(S, '+', dagOpFold(S, '*', du, v), dagOpFold(S, '*', u, dv));
+    case '/': {
+        if (duZero && dvZero) return du;
+        if (dvZero) return dagOpFold(S, '/', du, v);   // 󵼱(u/v)' = u'/v
+        Node* numerator = dagOpFold(S, '-', dagOpFold(S, '*', du, v), dagOpFold(S, '*', u, dv));
+        return dagOpFold(S, '/', numerator, dagOpFold(S, '^', v, S.num(2)));
+    }
+    case '^':
+        if (v->kind == 'N') {
+            // v ǳ => n * u^(n-1) * u'
+            double n = v->num;
+            if (std::fabs(n) < 1e-12) return S.num(0);
+            if (std::fabs(n - 1.0) < 1e-12 || duZero) return du;
+            return dagOpFold(S, '*', dagOpFold(S, '*', S.num(n), dagOpFold(S, '^', u, S.num(n - 1.0))), du);
+        }
+        if (duZero && dvZero) return du;
+        {
+            // ͨu^v * ( v' * ln(u) + v * (u'/u) )
+            Node* term1 = dvZero ? dv : dagOpFold(S, '*', dv, S.func('l', u));
+            Node* term2 = duZero ? du : dagOpFold(S, '*', v, dagOpFold(S, '/', du, u));
+            return dagOpFold(S, '*', p, dagOpFold(S, '+', term1, term2));
+        }
+    default:
+        if (err) *err = "δ֪޷";
+        return nullptr;
+    }
+}
+
+// root  var ƫ dagDerivRule ϣֱӹ uv ǿ¡ÿӱʽĵֻһ
+//  derivNode Ľ S.intern õĽڵ뱾Ľͬ
+// memo ǿʱΪڵ ->  var ĵļͬһֿ⡢ͬһʱͬһűĵֱӸ
+// root ڲֿ SҲ S Уʱ nullptr
+inline Node* dagDerivative(DagStore& S, Node* root, char var, string* err,
+    std::unordered_map<Node*, Node*>* memo = nullptr) {
+    if (!root) { if (err) *err = "ձʽ"; return nullptr; }
+    std::unordered_map<Node*, Node*> local;
+    std::unordered_map<Node*, Node*>& d = memo ? *memo : local;
+    vector<std::pair<Node*, bool>> st;
+    st.push_back({ root, false });
+
+    while (!st.empty()) {
+        Node* p = st.back().first;
+        bool expanded = st.back().second;
+        st.pop_back();
+        if (d.count(p)) continue;
+
+        if (p->kind == 'N') { d[p] = S.num(0); continue; }
+        if (p->kind == 'V') { d[p] = S.num(p->ch == var ? 1 : 0); continue; }
+        if (!p->l || (p->kind == 'O' && !p->r)) {
+            if (err) *err = p->ch == '^' ? "ݽڵȱӱʽ" : "սڵ";
+            return nullptr;
+        }
+        if (!expanded) {
+            st.push_back({ p, true });
+            if (p->kind == 'O') st.push_back({ p->r, false });
+            st.push_back({ p->l, false });
+            continue;
+        }
+
+        Node* res = dagDerivRule(S, p, d[p->l], p->kind == 'O' ? d[p->r] : nullptr, err);
+        if (!res) return nullptr;
+        d[p] = res;
+    }
+    return d[root];
+}
+
+// ===================== DAG  =====================
+
+// ӽڵѻĽڵ p Ӧ simplifyNode ĵ
+// again Ϊ true ʾͬϲؽҪ廯һ飨 simplifyNode ĵݹöӦ
+inline Node* dagSimplifyLocal(DagStore& S, Node* p, bool& again) {
+    again = false;
+    if (!p) return nullptr;
+
+    if (p->kind == 'F') {
+        double v = 0;
+        if (isNumLeaf(p->l, v)) {
+            switch (p->ch) {
+            case 's': return S.num(std::sin(v));
+            case 'c': return S.num(std::cos(v));
+            case 't': return S.num(std::tan(v));
+            case 'l': if (v > 0) return S.num(std::log(v)); break;
+            default: break;
+            }
+        }
+        return p;
+    }
+    if (p->kind != 'O') return p;
+
+    double lv = 0, rv = 0;
+    bool lConst = isNumLeaf(p->l, lv);
+    bool rConst = isNumLeaf(p->r, rv);
+    char op = p->ch;
+
+    // ߶ǳֱӼ
+    if (lConst && rConst) {
+        switch (op) {
+        case '+': return S.num(lv + rv);
+        case '-': return S.num(lv - rv);
+        case '*': return S.num(lv * rv);
+        case '/': if (std::fabs(rv) < 1e-12) break; return S.num(lv / rv);   //  simplifyLocal ͬNaN ճ
+        case '^': return S.num(std::pow(lv, rv));
+        default: break;
+        }
+    }
+
+    // ͬϲa + a + a  a * 3a*4 + a*5  a * 9
+    if (op == '+') {
+        std::vector<Node*> terms;
+        collectAddTerms(p, terms);
+        if (terms.size() >= 2) {
+            std::vector<std::pair<Node*, double>> infos;
+            for (Node* t : terms) {
+                Node* base;
+                double coef;
+                extractCoefAndBase(t, base, coef);
+                infos.push_back({ base, coef });
+            }
+
+            std::vector<std::pair<Node*, double>> grouped;
+            std::vector<bool> used(infos.size(), false);
+            for (size_t i = 0; i < infos.size(); ++i) {
+                if (used[i]) continue;
+                double totalCoef = infos[i].second;
+                Node* base = infos[i].first;
+                for (size_t j = i + 1; j < infos.size(); ++j) {
+                    if (used[j]) continue;
+                    bool sameBase = (!base && !infos[j].first) ||
+                        (base && infos[j].first && dagEqual(base, infos[j].first));
+                    if (sameBase) {
+                        totalCoef += infos[j].second;
+                        used[j] = true;
+                    }
+                }
+                grouped.push_back({ base, totalCoef });
+                used[i] = true;
+            }
+
+            if (grouped.size() < terms.size()) {
+                Node* result = nullptr;
+                for (auto& g : grouped) {
+                    Node* term;
+                    if (!g.first) term = S.num(g.second);
+                    else if (std::fabs(g.second - 1.0) < 1e-12) term = g.first;
+                    else if (std::fabs(g.second) < 1e-12) continue;
+                    else term = S.op('*', g.first, S.num(g.second));
+                    result = result ? S.op('+', result, term) : term;
+                }
+                if (!result) result = S.num(0);
+                again = true;
+                return result;
+            }
+        }
+    }
+
+    // ͬӺϲa * a * a  a ^ 3
+    if (op == '*') {
+        std::vector<Node*> factors;
+        collectMulTerms(p, factors);
+        if (factors.size() >= 2) {
+            double numProduct = 1.0;
+            std::vector<Node*> nonNum;
+            for (Node* f : factors) {
+                double v = 0;
+                if (isNumLeaf(f, v)) numProduct *= v;
+                else nonNum.push_back(f);
+            }
+
+            std::vector<std::pair<Node*, int>> grouped;
+            std::vector<bool> used(nonNum.size(), false);
+            for (size_t i = 0; i < nonNum.size(); ++i) {
+                if (used[i]) continue;
+                int count = 1;
+                for (size_t j = i + 1; j < nonNum.size(); ++j) {
+                    if (!used[j] && dagEqual(nonNum[i], nonNum[j])) {
+                        ++count;
+                        used[j] = true;
+                    }
+                }
+                grouped.push_back({ nonNum[i], count });
+                used[i] = true;
+            }
+
+            size_t expectedFactors = nonNum.size() + (std::fabs(numProduct - 1.0) >= 1e-12 ? 1 : 0);
+            bool hasNumMerge = (factors.size() > expectedFactors);
+            bool hasVarMerge = (grouped.size() < nonNum.size());
+            if (hasNumMerge || hasVarMerge) {
+                if (std::fabs(numProduct) < 1e-12) return S.num(0);
+
+                Node* result = nullptr;
+                if (std::fabs(numProduct - 1.0) >= 1e-12) result = S.num(numProduct);
+                for (auto& g : grouped) {
+                    Node* term = (g.second == 1) ? g.first : S.op('^', g.first, S.num((double)g.second));
+                    result = result ? S.op('*', result, term) : term;
+                }
+                if (!result) result = S.num(numProduct);
+                again = true;
+                return result;
+            }
+        }
+    }
+
+    // ʽx+00+xx-0x*0x*11*xx/1x^0x^1
+    if (op == '+') {
+        if (rConst && std::fabs(rv) < 1e-12) return p->l;
+        if (lConst && std::fabs(lv) < 1e-12) return p->r;
+    }
+    if (op == '-' && rConst && std::fabs(rv) < 1e-12) return p->l;
+    if (op == '*') {
+        if ((rConst && std::fabs(rv) < 1e-12) || (lConst && std::fabs(lv) < 1e-12)) return S.num(0);
+        if (rConst && std::fabs(rv - 1) < 1e-12) return p->l;
+        if (lConst && std::fabs(lv - 1) < 1e-12) return p->r;
+    }
+    if (op == '/' && rConst && std::fabs(rv - 1) < 1e-12) return p->l;
+    if (op == '^') {
+        if (rConst && std::fabs(rv) < 1e-12) return S.num(1);
+        if (rConst && std::fabs(rv - 1) < 1e-12) return p->l;
+    }
+    return p;
+}
+
+//  simplifyNode ͬĻ DAG޸κνڵ㣬ÿӱʽֻһ
+// root ڲֿ SҲ S 
+inline Node* dagSimplify(DagStore& S, Node* root) {
+    if (!root) return nullptr;
+    struct Frame {
+        Node* p;
+        int state;    // 0 = δչ1 = ӽڵѻ2 = ȴؽ
+        Node* redo;   // state 2Ҫٻؽ
+    };
+    std::unordered_map<Node*, Node*> memo;
+    vector<Frame> st;
+    st.push_back({ root, 0, nullptr });
+    auto get = [&](Node* c) { return c ? memo[c] : nullptr; };
+
+    while (!st.empty()) {
+        Frame f = st.back();
+        st.pop_back();
+        Node* p = f.p;
+
+        if (f.state == 2) {
+            memo[p] = memo[f.redo];
+            continue;
+        }
+        if (memo.count(p)) continue;
+
+        if (f.state == 0) {
+            st.push_back({ p, 1, nullptr });
+            if (p->kind == 'O' && p->r) st.push_back({ p->r, 0, nullptr });
+            if ((p->kind == 'O' || p->kind == 'F') && p->l) st.push_back({ p->l, 0, nullptr });
+            continue;
+        }
+
+        Node* n = p;
+        if (p->kind == 'F') n = S.func(p->ch, get(p->l));
+        else if (p->kind == 'O') n = S.op(p->ch, get(p->l), get(p->r));
+
+        bool again = false;
+        Node* res = dagSimplifyLocal(S, n, again);
+        if (!again) {
+            memo[p] = res;
+        }
+        else if (memo.count(res)) {
+            memo[p] = memo[res];
+        }
+        else {
+            st.push_back({ p, 2, res });
+            st.push_back({ res, 0, nullptr });
+        }
+    }
+    return memo[root];
+}
+
+// =====================  ExprTree ת =====================
+
+// ѱʽֿ
+inline Node* dagFromTree(DagStore& S, const ExprTree& T) {
+    return S.intern(T.root);
+}
+
+//  DAG չһöıʽӱʽᱻƣڵ dagTreeSize
+inline ExprTree dagToTree(Node* root) {
+    ExprTree T;
+    NodeArenaScope scope(T.ensureArena());
+    T.root = cloneTree(root);
+    T.updateCaches();
+    return T;
+}
+
+// ===================== ݶ Jacobian =====================
+
+//  root  vars ÿƫout[i] Ϊ root  vars[i] ƫñʱΪ 0
+// ģʽѰʽ adj(p) ӽڵ㣬adj(u) =  adj(p) * dp/du
+// ڵİ漴ƫʽΪƫУcos(u)u^vln(u) ڲֻֿһݣ
+// ȫƫܽڵʽģͬף
+// ʱ dagOpFold ۵󵼷 dudv Եģ a  p  uv  dagDerivRule 
+// (du, dv) = (a, 0)(0, a) ʱĽֲ derivNode ͬ
+// root ڲֿ SҲ S 
+inline bool dagGradient(DagStore& S, Node* root, const vector<char>& vars, vector<Node*>& out, string* err) {
+    out.assign(vars.size(), nullptr);
+    if (!root) { if (err) *err = "ձʽ"; return false; }
+
+    auto isNum = [](Node* p, double v) { return p->kind == 'N' && p->num == v; };
+
+    // õͬʱĽڵ㣨ӱʽûа棩
+    vector<Node*> order;
+    std::unordered_map<Node*, bool> varies;
+    vector<std::pair<Node*, bool>> st;
+    st.push_back({ root, false });
+    while (!st.empty()) {
+        Node* p = st.back().first;
+        bool expanded = st.back().second;
+        st.pop_back();
+        if (varies.count(p)) continue;
+        if (p->kind == 'O' || p->kind == 'F') {
+            if (!p->l || (p->kind == 'O' && !p->r)) {
+                if (err) *err = p->ch == '^' ? "ݽڵȱӱʽ" : "սڵ";
+                return false;
+            }
+            if (!expanded) {
+                st.push_back({ p, true });
+                if (p->kind == 'O') st.push_back({ p->r, false });
+                st.push_back({ p->l, false });
+                continue;
+            }
+            varies[p] = varies[p->l] || (p->kind == 'O' && varies[p->r]);
+        }
+        else {
+            varies[p] = p->kind == 'V';
+        }
+        order.push_back(p);
+    }
+
+    // ۼ
+    std::unordered_map<Node*, Node*> adj;
+    auto acc = [&](Node* c, Node* term) {
+        if (!varies[c] || isNum(term, 0)) return;
+        Node*& a = adj[c];
+        a = a ? S.op('+', a, term) : term;
+    };
+
+    Node* zero = S.num(0);
+    adj[root] = S.num(1);
+    for (size_t i = order.size(); i-- > 0;) {
+        Node* p = order[i];
+        if (!varies[p] || p->kind == 'V') continue;
+        auto it = adj.find(p);
+        if (it == adj.end()) continue;
+        Node* a = it->second;
+
+        if (p->kind == 'F' || varies[p->l]) {
+            Node* tu = dagDerivRule(S, p, a, p->kind == 'O' ? zero : nullptr, err);
+            if (!tu) return false;
+            acc(p->l, tu);
+        }
+        if (p->kind == 'O' && varies[p->r]) {
+            Node* tv = dagDerivRule(S, p, zero, a, err);
+            if (!tv) return false;
+            acc(p->r, tv);
+        }
+    }
+
+    for (size_t i = 0; i < vars.size(); ++i) {
+        auto it = adj.find(S.var(vars[i]));
+        out[i] = it != adj.end() ? it->second : S.num(0);
+    }
+    return true;
+}
+
+// ʽ JacobianJ[i][k] Ϊ roots[i]  vars[k] ƫͬһֿйӱʽ
+inline bool dagJacobian(DagStore& S, const vector<Node*>& roots, const vector<char>& vars,
+    vector<vector<Node*>>& J, string* err) {
+    J.assign(roots.size(), vector<Node*>());
+    for (size_t i = 0; i < roots.size(); ++i)
+        if (!dagGradient(S, roots[i], vars, J[i], err)) return false;
+    return true;
+}
+
+// ʽķݶ / Jacobianƫ DAG ʽԼĲֿУҪʱչ
+class GradientTree {
+public:
+    // ʽ collectVars() еÿƫ
+    bool build(const ExprTree& T, string* err) {
+        vector<const ExprTree*> one(1, &T);
+        return build(one, err);
+    }
+
+    // ʽȡʽ collectVars() Ĳ
+    bool build(const vector<const ExprTree*>& outputs, string* err) {
+        S.clear();
+        varList.clear();
+        J.clear();
+        std::set<char> all;
+        vector<Node*> roots;
+        for (const ExprTree* T : outputs) {
+            if (!T->root) { if (err) *err = "ձʽ"; return false; }
+            std::set<char> vs = T->collectVars();
+            all.insert(vs.begin(), vs.end());
+            roots.push_back(S.intern(T->root));
+        }
+        varList.assign(all.begin(), all.end());
+        if (!dagJacobian(S, roots, varList, J, err)) {
+            J.clear();
+            return false;
+        }
+        return true;
+    }
+
+    const vector<char>& vars() const { return varList; }
+    size_t rows() const { return J.size(); }
+
+    // outputs[row]  vars()[col] ƫDAG ڵ㣬ڱһ build ʧЧ
+    Node* partial(size_t row, size_t col) const { return J[row][col]; }
+
+    // չһöıʽ
+    ExprTree partialTree(size_t row, size_t col) const {
+        ExprTree D = dagToTree(J[row][col]);
+        D.postfixRaw = "<derivative>";
+        return D;
+    }
+
+    //  DAG ϻȫƫdagSimplifyչٶÿ simplify ͬչ
+    void simplify() {
+        for (auto& row : J)
+            for (Node*& d : row) d = dagSimplify(S, d);
+    }
+
+    // ȫƫϼƵĲͬڵӱʽֻһΣ
+    size_t nodeCount() const {
+        vector<Node*> all;
+        for (const auto& row : J) all.insert(all.end(), row.begin(), row.end());
+        return dagNodeCount(all);
+    }
+
+private:
+    DagStore S;
+    vector<char> varList;
+    vector<vector<Node*>> J;
+};
+
+// ===================== ߽ƫ Hessian =====================
+
+// 󵼣ͬһֿе DAG ƫʱÿӱʽÿֻһε
+//  (ڵ, ) ¹֮󵼸ã߽׵ƫHessian ĸӱʽ
+// ÿһ dagDerivative ļ
+class DerivativeCache {
+public:
+    explicit DerivativeCache(DagStore& store) : S(store) {}
+
+    // root  var ƫroot ڲֿ SҲ S Уʱ nullptr
+    Node* derivative(Node* root, char var, string* err) {
+        return dagDerivative(S, root, var, err, &memos[var]);
+    }
+
+    // ζ vars еıƫ {x, y} Ϊȶ x ٶ y Ķ׻ƫ
+    Node* partial(Node* root, const vector<char>& vars, string* err) {
+        Node* cur = root;
+        for (char v : vars) {
+            cur = derivative(cur, v, err);
+            if (!cur) return nullptr;
+        }
+        return cur;
+    }
+
+    //  var  n ׵n = 0 ʱΪ root 
+    Node* nth(Node* root, char var, int n, string* err) {
+        return partial(root, vector<char>((size_t)std::max(n, 0), var), err);
+    }
+
+    // H[i][k] Ϊȶ vars[i] ٶ vars[k] Ķƫƫ󵼴޹أֻ
+    bool hessian(Node* root, const vector<char>& vars, vector<vector<Node*>>& H, string* err) {
+        H.assign(vars.size(), vector<Node*>(vars.size(), nullptr));
+        for (size_t i = 0; i < vars.size(); ++i) {
+            Node* g = derivative(root, vars[i], err);
+            if (!g) return false;
+            for (size_t k = i; k < vars.size(); ++k) {
+                H[i][k] = H[k][i] = derivative(g, vars[k], err);
+                if (!H[i][k]) return false;
+            }
+        }
+        return true;
+    }
+
+    // Ѽµ (ڵ, ) 
+    size_t memoSize() const {
+        size_t n = 0;
+        for (const auto& kv : memos) n += kv.second.size();
+        return n;
+    }
+
+    // ռ䣨ֿⱻ clear ã
+    void clear() { memos.clear(); }
+
+private:
+    DagStore& S;
+    std::map<char, std::unordered_map<Node*, Node*>> memos;   //  -> (ڵ -> )
+};
+
+// ζ vars еıƫչıʽʱΪգ
+inline ExprTree MixedPartialTree(const ExprTree& T, const vector<char>& vars, string* err) {
+    if (!T.root) { if (err) *err = "ձʽ"; return ExprTree(); }
+    DagStore S;
+    DerivativeCache cache(S);
+    Node* r = cache.partial(S.intern(T.root), vars, err);
+    if (!r) return ExprTree();
+    ExprTree D = dagToTree(r);
+    D.postfixRaw = "<derivative>";
+    return D;
+}
+
+//  var  n ׵
+inline ExprTree NthDerivativeTree(const ExprTree& T, char var, int n, string* err) {
+    return MixedPartialTree(T, vector<char>((size_t)std::max(n, 0), var), err);
+}
+
+// ʽ Hessianƫ DAG ʽԼĲֿУӱʽһ׵
+class HessianTree {
+public:
+    HessianTree() : cache(S) {}
+
+    //  collectVars() еıƫ
+    bool build(const ExprTree& T, string* err) {
+        cache.clear();
+        S.clear();
+        H.clear();
+        std::set<char> vs = T.collectVars();
+        varList.assign(vs.begin(), vs.end());
+        if (!T.root) { if (err) *err = "ձʽ"; return false; }
+        if (!cache.hessian(S.intern(T.root), varList, H, err)) {
+            H.clear();
+            return false;
+        }
+        return true;
+    }
+
+    const vector<char>& vars() const { return varList; }
+
+    // ȶ vars()[i] ٶ vars()[k] ĶƫDAG ڵ㣬ڱ
+    Node* partial(size_t i, size_t k) const { return H[i][k]; }
+
+    // չһöıʽ
+    ExprTree partialTree(size_t i, size_t k) const {
+        ExprTree D = dagToTree(H[i][k]);
+        D.postfixRaw = "<derivative>";
+        return D;
+    }
+
+    // ȫƫϼƵĲͬڵ
+    size_t nodeCount() const {
+        vector<Node*> all;
+        for (const auto& row : H) all.insert(all.end(), row.begin(), row.end());
+        return dagNodeCount(all);
+    }
+
+private:
+    DagStore S;
+    DerivativeCache cache;
+    vector<char> varList;
+    vector<vector<Node*>> H;
+};
+
+#endif // PPE_DAG_H
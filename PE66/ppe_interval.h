@@ -0,0 +1,235 @@
+#ifndef PPE_INTERVAL_H
+#define PPE_INTERVAL_H
+
+#include "ppe_compile.h"
+
+#include <limits>
+
+// ===================== ֵֵΧ =====================
+
+// ÿһȡֵΧ [lo, hi]ʽΧϵֵΧ
+// ΧǿɿģΧһ ExprTree::eval ɹҽ NaN ʱһ
+// ÿչ 1~2 ulpǸͱ׼⺯
+// ͬһֶʱȡֵƫ x-x õ [lo-hi, hi-lo]
+//  CompiledExpr ֽ루 compileCse ļĴָһμɶԴΧֵ
+
+struct Interval {
+    double lo, hi;
+};
+
+// ֵϱ־ϣ
+enum IntervalFlag : unsigned char {
+    IV_OK = 0,
+    IV_DIV_ZERO = 1,      // Χڿֳܳ㣨|| < 1e-12 eval жͬ
+    IV_LN_DOMAIN = 2,     // Χڿܳ ln  <= 0
+    IV_ALWAYS_FAIL = 4,   // Χÿһֵʧܻ;õ NaNսڵ/δ֪ʱΪ NaN
+};
+
+const double IV_INF = std::numeric_limits<double>::infinity();
+
+// ʵᣨ޷İΧʱʹã
+inline Interval ivWhole() { return { -IV_INF, IV_INF }; }
+
+//  [lo, hi] չ ulps  ulp˵ NaN 0*infʱ˻Ϊʵ
+//  |x|*2^-52 ӼС x  1  ulpƶ 1  ulp nextafter ö
+inline Interval ivOut(double lo, double hi, int ulps) {
+    if (lo != lo || hi != hi) return ivWhole();
+    const double rel = ulps * 2.220446049250313e-16;
+    const double tiny = ulps * 4.9406564584124654e-324;   // 0 Сչ
+    if (lo != IV_INF) lo -= std::fabs(lo) * rel + tiny;
+    if (hi != -IV_INF) hi += std::fabs(hi) * rel + tiny;
+    return { lo, hi };
+}
+
+// ĸ˵ϵС/ֵ˳ݺڸϵʱļֵڶ˵ϴ
+inline Interval ivCorners(double a, double b, double c, double d, int ulps) {
+    if (a != a || b != b || c != c || d != d) return ivWhole();
+    return ivOut((std::min)((std::min)(a, b), (std::min)(c, d)),
+        (std::max)((std::max)(a, b), (std::max)(c, d)), ulps);
+}
+
+inline Interval ivAdd(Interval x, Interval y) { return ivOut(x.lo + y.lo, x.hi + y.hi, 1); }
+inline Interval ivSub(Interval x, Interval y) { return ivOut(x.lo - y.hi, x.hi - y.lo, 1); }
+
+inline Interval ivMul(Interval x, Interval y) {
+    return ivCorners(x.lo * y.lo, x.lo * y.hi, x.hi * y.lo, x.hi * y.hi, 1);
+}
+
+//  |y| < 1e-12 Ĳ eval б㣬ȡֵʣµηֱϲ
+inline Interval ivDiv(Interval x, Interval y, unsigned char& flags) {
+    const double eps = 1e-12;
+    if (y.lo < eps && y.hi > -eps) flags |= IV_DIV_ZERO;
+    bool hasNeg = y.lo <= -eps, hasPos = y.hi >= eps;
+    if (!hasNeg && !hasPos) {
+        flags |= IV_ALWAYS_FAIL;
+        return ivWhole();
+    }
+    Interval r = { IV_INF, -IV_INF };
+    auto piece = [&](double c, double d) {
+        Interval q = ivCorners(x.lo / c, x.lo / d, x.hi / c, x.hi / d, 1);
+        r.lo = (std::min)(r.lo, q.lo);
+        r.hi = (std::max)(r.hi, q.hi);
+    };
+    if (hasNeg) piece(y.lo, (std::min)(y.hi, -eps));
+    if (hasPos) piece((std::max)(y.lo, eps), y.hi);
+    return r;
+}
+
+// ݣǸʱ pow Եֱָ𵥵ֵĸ˵ϴ
+// Ϊʱָֻࣨܵõ NaNʵ
+// ¶˵Ϊ -0 ʱΪpow(-0, ) Ϊ -inf㵥
+inline Interval ivPow(Interval x, Interval y) {
+    if (x.lo > 0 || (x.lo == 0 && !std::signbit(x.lo))) {
+        Interval r = ivCorners(std::pow(x.lo, y.lo), std::pow(x.lo, y.hi),
+            std::pow(x.hi, y.lo), std::pow(x.hi, y.hi), 2);
+        r.lo = (std::max)(r.lo, 0.0);
+        return r;
+    }
+    double n = y.lo;
+    if (y.lo != y.hi || n != std::floor(n) || std::fabs(n) > 9007199254740992.0) return ivWhole();
+    if (n == 0) return { 1, 1 };   // pow(x, 0) Ϊ 1
+
+    double pa = std::pow(x.lo, n), pb = std::pow(x.hi, n);
+    bool even = std::fmod(n, 2.0) == 0;
+    if (x.hi < 0) return ivCorners(pa, pb, pa, pb, 2);   //  0
+    if (n > 0) {
+        if (even) return { 0, ivOut(0, (std::max)(pa, pb), 2).hi };   // ½ 0 Ǿȷֵ
+        return ivOut(pa, pb, 2);
+    }
+    // ָҵΧ 00 
+    if (even) return ivOut((std::min)(pa, pb), IV_INF, 2);
+    return ivWhole();
+}
+
+// [lo, hi] Ƿ phase + k*period ʽĵ㣻˰ֵſɶ౨
+inline bool ivHasPeriodPoint(double lo, double hi, double phase, double period) {
+    double slack = 1e-9 * (1 + (std::max)(std::fabs(lo), std::fabs(hi)));
+    double k = std::ceil((lo - slack - phase) / period);
+    return phase + k * period <= hi + slack;
+}
+
+const double IV_PI = 3.14159265358979323846;
+// Աֵʱ sin/cos/tan жϲٿɿֱӸĽ
+const double IV_TRIG_LIMIT = 1e9;
+
+// sin/cosں/͵ʱȡ 1ϵȡ
+inline Interval ivSinCos(Interval x, bool isCos) {
+    if (!(x.hi - x.lo < 2 * IV_PI) || (std::max)(std::fabs(x.lo), std::fabs(x.hi)) > IV_TRIG_LIMIT)
+        return { -1, 1 };
+    double maxPhase = isCos ? 0 : IV_PI / 2;
+    double minPhase = isCos ? IV_PI : -IV_PI / 2;
+    double a = isCos ? std::cos(x.lo) : std::sin(x.lo);
+    double b = isCos ? std::cos(x.hi) : std::sin(x.hi);
+    Interval r = ivOut((std::min)(a, b), (std::max)(a, b), 2);
+    if (ivHasPeriodPoint(x.lo, x.hi, maxPhase, 2 * IV_PI)) r.hi = 1;
+    if (ivHasPeriodPoint(x.lo, x.hi, minPhase, 2 * IV_PI)) r.lo = -1;
+    r.lo = (std::max)(r.lo, -1.0);
+    r.hi = (std::min)(r.hi, 1.0);
+    return r;
+}
+
+// tanں㣨/2 + kУʱΪʵᣬ򵥵
+inline Interval ivTan(Interval x) {
+    if (!(x.hi - x.lo < IV_PI) || (std::max)(std::fabs(x.lo), std::fabs(x.hi)) > IV_TRIG_LIMIT ||
+        ivHasPeriodPoint(x.lo, x.hi, IV_PI / 2, IV_PI))
+        return ivWhole();
+    return ivOut(std::tan(x.lo), std::tan(x.hi), 2);
+}
+
+// ln <= 0 Ĳ eval бȡֵ 0 ʹ½ڸ
+inline Interval ivLn(Interval x, unsigned char& flags) {
+    if (x.hi <= 0) {
+        flags |= IV_LN_DOMAIN | IV_ALWAYS_FAIL;
+        return ivWhole();
+    }
+    if (x.lo <= 0) {
+        flags |= IV_LN_DOMAIN;
+        return ivOut(-IV_INF, std::log(x.hi), 2);
+    }
+    return ivOut(std::log(x.lo), std::log(x.hi), 2);
+}
+
+// ջbox[slot] Ϊ slot ȡֵΧstack  maxStack + numRegs Ԫ
+inline unsigned char runInterval(const CompiledExpr& C, const Interval* box, Interval* stack, Interval& out) {
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    out = { nan, nan };
+    if (C.code.empty()) return IV_ALWAYS_FAIL;
+
+    Interval* regs = stack + C.maxStack;
+    unsigned char flags = IV_OK;
+    int top = -1;
+    for (const Instr& in : C.code) {
+        switch (in.op) {
+        case OP_CONST: {
+            double v = C.consts[in.arg];
+            stack[++top] = { v, v };
+            break;
+        }
+        case OP_VAR: stack[++top] = box[in.arg]; break;
+        case OP_ADD: --top; stack[top] = ivAdd(stack[top], stack[top + 1]); break;
+        case OP_SUB: --top; stack[top] = ivSub(stack[top], stack[top + 1]); break;
+        case OP_MUL: --top; stack[top] = ivMul(stack[top], stack[top + 1]); break;
+        case OP_DIV: --top; stack[top] = ivDiv(stack[top], stack[top + 1], flags); break;
+        case OP_POW: --top; stack[top] = ivPow(stack[top], stack[top + 1]); break;
+        case OP_SIN: stack[top] = ivSinCos(stack[top], false); break;
+        case OP_COS: stack[top] = ivSinCos(stack[top], true); break;
+        case OP_TAN: stack[top] = ivTan(stack[top]); break;
+        case OP_LN: stack[top] = ivLn(stack[top], flags); break;
+        case OP_STORE: regs[in.arg] = stack[top]; break;
+        case OP_LOAD: stack[++top] = regs[in.arg]; break;
+        default: flags |= IV_ALWAYS_FAIL; break;
+        }
+        if (flags & IV_ALWAYS_FAIL) return flags;   // ÿһ㶼ʧܣ治
+    }
+    out = stack[0];
+    return flags;
+}
+
+// Χϵֵbox[slot] Ϊ slot CompiledExpr::slotVarsȡֵΧ
+//  IntervalFlag 
+inline unsigned char evalInterval(const CompiledExpr& C, const Interval* box, Interval& out) {
+    Interval small[64];
+    vector<Interval> big;
+    Interval* stack = small;
+    if (C.maxStack + C.numRegs > 64) {
+        big.resize(C.maxStack + C.numRegs);
+        stack = big.data();
+    }
+    return runInterval(C, box, stack, out);
+}
+
+//  n Χֵ i Χб slot ȡֵΧΪ cols[slot][i] evalBatch ͬİв֣
+// д out[0..n)flags ǿʱдÿΧ IntervalFlagֻһջ
+inline void evalIntervalBatch(const CompiledExpr& C, const Interval* const* cols, size_t n,
+    Interval* out, unsigned char* flags) {
+    size_t slots = C.slotVars.size();
+    vector<Interval> work(slots + (size_t)C.maxStack + (size_t)C.numRegs);
+    Interval* box = work.data();
+    Interval* stack = box + slots;
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t s = 0; s < slots; ++s) box[s] = cols[s][i];
+        unsigned char f = runInterval(C, box, stack, out[i]);
+        if (flags) flags[i] = f;
+    }
+}
+
+// ݽӿڣȡֵΧȱٱΧϷlo > hi  NaNʱ false
+inline bool evalInterval(const ExprTree& T, const std::map<char, Interval>& vars, Interval& out,
+    unsigned char* flags, string* err) {
+    CompiledExpr C;
+    C.compile(T);
+
+    vector<Interval> box;
+    if (!C.bindSlots(vars, box, err)) return false;
+    for (size_t i = 0; i < box.size(); ++i) {
+        if (!(box[i].lo <= box[i].hi)) {
+            if (err) *err = "䲻Ϸ: " + varNameFromCode(C.slotVars[i]);
+            return false;
+        }
+    }
+    unsigned char f = evalInterval(C, box.data(), out);
+    if (flags) *flags = f;
+    return true;
+}
+
+#endif // PPE_INTERVAL_H
@@ -0,0 +1,232 @@
+#ifndef PPE_PARALLEL_H
+#define PPE_PARALLEL_H
+
+#include "ppe_batch.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <exception>
+
+// ===================== ȡ̳߳ =====================
+
+// ̶Ḷ́߳ÿ߳ԼУԼĶп˾ʹӱĶͷȡ
+//  parallelFor ߳ҲִУֱзֿɲŷ
+// ͬһʱֻһ񣺲ͬ߳ͬʱ parallelFor ʱŶִ
+class WorkStealingPool {
+public:
+    // threads Ϊ 0 ʱʹӲ̱߳߳һ
+    explicit WorkStealingPool(unsigned threads = 0) {
+        if (threads == 0) threads = std::thread::hardware_concurrency();
+        if (threads == 0) threads = 1;
+        queues = vector<Queue>(threads);
+        for (unsigned i = 1; i < threads; ++i)
+            workers.emplace_back([this, i] { workerLoop(i); });
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lk(wakeMutex);
+            stopping = true;
+        }
+        wakeCv.notify_all();
+        for (auto& t : workers) t.join();
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // ִе̣߳߳
+    unsigned size() const { return (unsigned)queues.size(); }
+
+    //  [0, n) гɳΪ chunk Ŀ鲢ִ fn(begin, end)ֱȫ
+    // ÿֻдԼʱ봮ִȫһ
+    // ڱصڲfn Уٴεʱֱڵǰ̴ִ߳У
+    // fn ׳쳣ʱδʼĿ鲻ִУѿʼĿڵ߳׳һ쳣
+    void parallelFor(size_t n, size_t chunk, const std::function<void(size_t, size_t)>& fn) {
+        if (n == 0) return;
+        if (chunk == 0) chunk = 1;
+        size_t chunks = (n + chunk - 1) / chunk;
+        if (queues.size() == 1 || chunks == 1 || runningPool() == this) {
+            for (size_t b = 0; b < n; b += chunk) fn(b, (std::min)(n, b + chunk));
+            return;
+        }
+
+        std::lock_guard<std::mutex> job(jobMutex);  // ͬһʱֻһ
+        RunningScope running(this);
+        task = &fn;
+        error = nullptr;
+        failed.store(false);
+        pending.store(chunks);
+
+        // Ŀָͬһ̣֤߳߳ȴڴ
+        size_t per = (chunks + queues.size() - 1) / queues.size();
+        for (size_t q = 0; q < queues.size(); ++q) {
+            std::lock_guard<std::mutex> lk(queues[q].m);
+            for (size_t c = q * per; c < (std::min)(chunks, (q + 1) * per); ++c)
+                queues[q].ranges.push_back({ c * chunk, (std::min)(n, (c + 1) * chunk) });
+        }
+        {
+            std::lock_guard<std::mutex> lk(wakeMutex);
+            ++generation;
+        }
+        wakeCv.notify_all();
+
+        runTasks(0);
+
+        std::unique_lock<std::mutex> lk(doneMutex);
+        doneCv.wait(lk, [this] { return pending.load() == 0; });
+        task = nullptr;
+        if (error) {
+            std::exception_ptr e = error;
+            error = nullptr;
+            std::rethrow_exception(e);
+        }
+    }
+
+private:
+    struct Range {
+        size_t begin, end;
+    };
+
+    struct Queue {
+        std::mutex m;
+        std::deque<Range> ranges;
+    };
+
+    // ǰ߳Ϊĸִ񣨹߳ʼΪĳأ
+    static const WorkStealingPool*& runningPool() {
+        thread_local const WorkStealingPool* cur = nullptr;
+        return cur;
+    }
+
+    struct RunningScope {
+        explicit RunningScope(const WorkStealingPool* p) : prev(runningPool()) { runningPool() = p; }
+        ~RunningScope() { runningPool() = prev; }
+        const WorkStealingPool* prev;
+    };
+
+    void workerLoop(unsigned id) {
+        runningPool() = this;
+        unsigned long seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lk(wakeMutex);
+                wakeCv.wait(lk, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+            }
+            runTasks(id);
+        }
+    }
+
+    // ԼĶдβȡ롢ȣ
+    bool popLocal(unsigned id, Range& r) {
+        Queue& q = queues[id];
+        std::lock_guard<std::mutex> lk(q.m);
+        if (q.ranges.empty()) return false;
+        r = q.ranges.back();
+        q.ranges.pop_back();
+        return true;
+    }
+
+    // ͷȡԷڴλԶ
+    bool steal(unsigned id, Range& r) {
+        for (size_t k = 1; k < queues.size(); ++k) {
+            Queue& q = queues[(id + k) % queues.size()];
+            std::lock_guard<std::mutex> lk(q.m);
+            if (q.ranges.empty()) continue;
+            r = q.ranges.front();
+            q.ranges.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    void runTasks(unsigned id) {
+        Range r;
+        while (popLocal(id, r) || steal(id, r)) {
+            // п׳쳣ʱʣĿ飬Ҫ̲ܷ߳
+            if (!failed.load()) {
+                try {
+                    (*task)(r.begin, r.end);
+                }
+                catch (...) {
+                    std::lock_guard<std::mutex> lk(doneMutex);
+                    if (!error) error = std::current_exception();
+                    failed.store(true);
+                }
+            }
+            if (pending.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lk(doneMutex);
+                doneCv.notify_all();
+            }
+        }
+    }
+
+    vector<Queue> queues;
+    vector<std::thread> workers;
+
+    std::mutex jobMutex;
+    const std::function<void(size_t, size_t)>* task = nullptr;
+    std::atomic<size_t> pending{ 0 };
+    std::atomic<bool> failed{ false };
+    std::exception_ptr error;   // һ׳쳣doneMutex 
+
+    std::mutex wakeMutex;
+    std::condition_variable wakeCv;
+    unsigned long generation = 0;
+    bool stopping = false;
+
+    std::mutex doneMutex;
+    std::condition_variable doneCv;
+};
+
+// ڹĬ̳߳أ״ʹʱ
+inline WorkStealingPool& defaultPool() {
+    static WorkStealingPool pool;
+    return pool;
+}
+
+// ===================== ֵ߳ =====================
+
+// Ĭÿ
+const size_t PARALLEL_CHUNK_ROWS = 1 << 16;
+
+//  evalBatch ͬ壬п̳߳ϲִУԭд out/status
+// ÿн봮ֵλһ£߳͵˳޹
+inline void evalBatchParallel(const CompiledExpr& C, const double* const* cols, size_t n,
+    double* out, unsigned char* status, WorkStealingPool& pool, size_t chunkRows = PARALLEL_CHUNK_ROWS) {
+    // Ϊ߳ 4 ȡ
+    size_t chunk = (std::min)(chunkRows, (n + pool.size() * 4 - 1) / (pool.size() * 4));
+    if (chunk < BATCH_BLOCK) chunk = BATCH_BLOCK;
+
+    size_t slots = C.slotVars.size();
+    pool.parallelFor(n, chunk, [&](size_t begin, size_t end) {
+        const double* small[16];
+        vector<const double*> big;
+        const double** shifted = small;
+        if (slots > 16) {
+            big.resize(slots);
+            shifted = big.data();
+        }
+        for (size_t s = 0; s < slots; ++s) shifted[s] = cols[s] + begin;
+        evalBatch(C, shifted, end - begin, out + begin, status ? status + begin : nullptr);
+    });
+}
+
+// ݽӿڣṩУʹĬ̳߳
+inline bool evalBatchParallel(const ExprTree& T, const std::map<char, const double*>& cols, size_t n,
+    double* out, unsigned char* status, string* err) {
+    CompiledExpr C;
+    C.compile(T);
+
+    vector<const double*> slotCols;
+    if (!C.bindSlots(cols, slotCols, err)) return false;
+    evalBatchParallel(C, slotCols.data(), n, out, status, defaultPool());
+    return true;
+}
+
+#endif // PPE_PARALLEL_H
@@ -0,0 +1,310 @@
+#ifndef PPE_STREAM_H
+#define PPE_STREAM_H
+
+#include "ppe.h"
+
+#include <cstdio>
+#include <cstring>
+#include <functional>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// ===================== ʽ׺ʽ =====================
+
+// Ϊзָĺ׺ʽÿһ¼
+// ̶СֻĳһбȻ廹ʱ󵽸гȣм¼ͬһ arena
+// ڴֵֻȡһУļС޹
+
+// Ĭ϶Сֽڣ
+const size_t STREAM_CHUNK = 1 << 16;
+
+// һ¼
+struct StreamRecord {
+    size_t line;        // кţ 1 ʼ
+    const char* text;   // ݣзֻڻصڼЧ
+    size_t len;
+};
+
+// ʽͳ
+struct StreamStats {
+    size_t lines = 0;     // 
+    size_t records = 0;   // ǿռ¼
+    size_t parsed = 0;    // ɹļ¼
+    size_t failed = 0;    // ʧܵļ¼
+    size_t bytes = 0;     // ֽ
+    size_t maxLine = 0;   // һеֽ
+};
+
+// ɹĻص false ֹͣ룻ڻصغᱻһ¼
+using StreamTreeFn = std::function<bool(const StreamRecord&, ExprTree&)>;
+// ʧܵĻصerr ΪϢ false ֹͣ
+using StreamErrorFn = std::function<bool(const StreamRecord&, const string&)>;
+
+// ---------- ȡжȡ ----------
+
+class ChunkLineReader {
+public:
+    explicit ChunkLineReader(FILE* f, size_t chunk = STREAM_CHUNK) : in(f), buf(chunk ? chunk : 1) {}
+
+    // ȡһУ '\n'data ´εǰЧ귵 false
+    bool next(const char*& data, size_t& len) {
+        while (true) {
+            const char* nl = (const char*)std::memchr(buf.data() + pos, '\n', end - pos);
+            if (nl) {
+                data = buf.data() + pos;
+                len = (size_t)(nl - data);
+                pos += len + 1;
+                return true;
+            }
+            if (eof) {
+                if (pos == end) return false;
+                data = buf.data() + pos;   // һûлз
+                len = end - pos;
+                pos = end;
+                return true;
+            }
+            // δİƵ忪ͷһ鶼װһʱ󻺳
+            if (pos > 0) {
+                std::memmove(buf.data(), buf.data() + pos, end - pos);
+                end -= pos;
+                pos = 0;
+            }
+            if (end == buf.size()) buf.resize(buf.size() * 2);
+            size_t got = std::fread(buf.data() + end, 1, buf.size() - end, in);
+            end += got;
+            if (got == 0) {
+                eof = true;
+                failed = std::ferror(in) != 0;
+            }
+        }
+    }
+
+    bool error() const { return failed; }
+
+private:
+    FILE* in;
+    vector<char> buf;
+    size_t pos = 0;     // һе
+    size_t end = 0;     // Чݵĩβ
+    bool eof = false;
+    bool failed = false;
+};
+
+// ---------- ڴӳļ ----------
+
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const string& path, string* err) {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) { if (err) *err = "޷ļ: " + path; return false; }
+        LARGE_INTEGER sz;
+        if (!GetFileSizeEx(file, &sz)) { if (err) *err = "޷ȡļС: " + path; close(); return false; }
+        len = (size_t)sz.QuadPart;
+        if (len == 0) return true;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) { if (err) *err = "޷ӳļ: " + path; close(); return false; }
+        ptr = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!ptr) { if (err) *err = "޷ӳļ: " + path; close(); return false; }
+#else
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) { if (err) *err = "޷ļ: " + path; return false; }
+        struct stat sb;
+        if (fstat(fd, &sb) != 0) { if (err) *err = "޷ȡļС: " + path; close(); return false; }
+        len = (size_t)sb.st_size;
+        if (len == 0) return true;
+        void* p = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) { if (err) *err = "޷ӳļ: " + path; close(); return false; }
+        madvise(p, len, MADV_SEQUENTIAL);
+        ptr = (const char*)p;
+#endif
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (ptr) UnmapViewOfFile(ptr);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (ptr) munmap((void*)ptr, len);
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+#endif
+        ptr = nullptr;
+        len = 0;
+    }
+
+    const char* data() const { return ptr; }
+    size_t size() const { return len; }
+
+    // ֪ϵͳ [0, offset) Ѷ꣬Իⲿҳ棨ļܴʱפڴ治ȡλ
+    void release(size_t offset) const {
+#ifdef _WIN32
+        // ֻӳҳϵͳԶգ账
+        (void)offset;
+#else
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        offset -= offset % page;
+        if (ptr && offset) madvise((void*)ptr, offset, MADV_DONTNEED);
+#endif
+    }
+
+private:
+    const char* ptr = nullptr;
+    size_t len = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+// ڴӳϰз֣ݣÿ STREAM_MMAP_WINDOW ֽڻһѶҳ
+const size_t STREAM_MMAP_WINDOW = 16 << 20;
+
+class MappedLineReader {
+public:
+    explicit MappedLineReader(const MappedFile& f)
+        : file(f), p(f.data()), end(f.data() + f.size()), nextRelease(STREAM_MMAP_WINDOW) {}
+
+    bool next(const char*& data, size_t& len) {
+        if (p >= end) return false;
+        size_t offset = (size_t)(p - file.data());
+        if (offset >= nextRelease) {
+            // һеڻص꣬յǰ֮ǰ
+            file.release(offset);
+            nextRelease = offset + STREAM_MMAP_WINDOW;
+        }
+        const char* nl = (const char*)std::memchr(p, '\n', (size_t)(end - p));
+        data = p;
+        len = nl ? (size_t)(nl - p) : (size_t)(end - p);
+        p += len + (nl ? 1 : 0);
+        return true;
+    }
+
+    bool error() const { return false; }
+
+private:
+    const MappedFile& file;
+    const char* p;
+    const char* end;
+    size_t nextRelease;   // ƫʱ֮ǰҳ
+};
+
+// ---------- ѭ ----------
+
+// нص¼ʧֻ onErrorж϶
+// ڼʹԼıʼʱƵ÷ǰֱѵǼǵı벻䣩
+// ÿ¼ػԭС˼¼³ֵĶַıֻڸü¼ĻصڼЧ
+// ÿ¼ VAR_CODE_MAX ȥѵǼǸ֣¼޹
+// ʱ false
+template <class LineSource>
+inline bool streamRecords(LineSource& src, const StreamTreeFn& onTree, const StreamErrorFn& onError,
+    StreamStats* stats) {
+    StreamStats local;
+    StreamStats& st = stats ? *stats : local;
+    VarNameTable names = snapshotVarNames();
+    const size_t baseNames = names.size();
+    VarNameScope nameScope(&names);
+    ExprTree T;        // м¼ͬһclear() ʱ arena ڴ鱣ã
+    string perr;
+    const char* data;
+    size_t len;
+
+    while (src.next(data, len)) {
+        ++st.lines;
+        st.bytes += len + 1;
+        if (len && data[len - 1] == '\r') --len;
+
+        size_t k = 0;
+        while (k < len && (data[k] == ' ' || data[k] == '\t')) ++k;
+        if (k == len) continue;   // 
+
+        ++st.records;
+        if (len > st.maxLine) st.maxLine = len;
+        StreamRecord rec{ st.lines, data, len };
+        bool go;
+        if (!T.parsePostfix(data, len, &perr)) {
+            ++st.failed;
+            go = !onError || onError(rec, perr);
+        }
+        else {
+            ++st.parsed;
+            go = !onTree || onTree(rec, T);
+        }
+        names.truncate(baseNames);
+        if (!go) break;
+    }
+    T.clear();
+    return !src.error();
+}
+
+// Ѵ򿪵 FILE* ʽ루 stdin
+inline bool streamPostfix(FILE* in, const StreamTreeFn& onTree, const StreamErrorFn& onError,
+    StreamStats* stats, string* err, size_t chunk = STREAM_CHUNK) {
+    ChunkLineReader reader(in, chunk);
+    if (!streamRecords(reader, onTree, onError, stats)) {
+        if (err) *err = "ȡʧ";
+        return false;
+    }
+    return true;
+}
+
+// ļʽ룻path Ϊ "-" ʱ׼룻useMmap Ϊ true ʱڴӳ䣨ʧʱ˻ذȡ
+inline bool streamPostfixFile(const string& path, bool useMmap, const StreamTreeFn& onTree,
+    const StreamErrorFn& onError, StreamStats* stats, string* err, size_t chunk = STREAM_CHUNK) {
+    if (path == "-") return streamPostfix(stdin, onTree, onError, stats, err, chunk);
+
+    if (useMmap) {
+        MappedFile mf;
+        if (mf.open(path, nullptr)) {
+            MappedLineReader reader(mf);
+            return streamRecords(reader, onTree, onError, stats);
+        }
+    }
+
+    FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f) { if (err) *err = "޷ļ: " + path; return false; }
+    bool ok = streamPostfix(f, onTree, onError, stats, err, chunk);
+    std::fclose(f);
+    return ok;
+}
+
+// ʽֵÿ¼ vars ֵֵ/󣩽 onValue
+// onValue(¼, Ƿɹ, ֵ, Ϣ) false ֹͣ
+using StreamValueFn = std::function<bool(const StreamRecord&, bool, double, const string&)>;
+
+inline bool streamEvalFile(const string& path, bool useMmap, const std::map<char, double>& vars,
+    const StreamValueFn& onValue, StreamStats* stats, string* err) {
+    string evalErr;
+    return streamPostfixFile(path, useMmap,
+        [&](const StreamRecord& rec, ExprTree& T) {
+            double v = 0;
+            bool ok = T.eval(vars, v, &evalErr);
+            return onValue(rec, ok, v, ok ? string() : evalErr);
+        },
+        [&](const StreamRecord& rec, const string& perr) {
+            return onValue(rec, false, 0, perr);
+        },
+        stats, err);
+}
+
+#endif // PPE_STREAM_H
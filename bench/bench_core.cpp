@@ -0,0 +1,666 @@
+﻿// 核心算法微基准（Google Benchmark）
+// 在生成的表达式上测量各算法，表达式的规模、形状、运算符组成和变量数可控
+//
+// 用法：bench_core [--expr=规格 ...] [Google Benchmark 参数]
+//   规格：shape:random,nodes:10000,vars:4,ops:+-*,funcs:sc,seed:1（各项可省略，以上为默认值）
+//     shape  balanced（满二叉）| random（随机切分）| chain（左深链，树深 ≈ 节点数/2）
+//     ops    二元运算符集合；funcs 一元函数集合（s=sin c=cos t=tan l=ln，留空表示不用函数）
+//   不给 --expr 时运行默认的一组规格
+//   机器可读输出：--benchmark_format=json 或 --benchmark_out=结果.json
+//
+// wrapSubtree 为局部修改后增量更新缓存串的耗时（对比 toPostfix + toInfix 的整串重建）
+// copyPathWrap 为保留旧版本的修改（路径复制后再包裹，撤销快照的做法；对比 cloneTree 的整树深拷贝）
+// 计数器：ns/node = 每次操作的耗时 / 输入树节点数；allocs/op、bytes/op = 每次操作的堆分配次数和字节数
+
+#include "ppe.h"
+#include "ppe_dag.h"
+#include "ppe_interval.h"
+#include "ppe_autodiff.h"
+
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+
+// ===================== 堆分配计数 =====================
+
+static size_t g_allocs = 0;
+static size_t g_allocBytes = 0;
+static bool g_counting = false;   // 只统计计时区间内的分配
+
+#if defined(_MSC_VER)
+#define BENCH_NOINLINE __declspec(noinline)
+#else
+#define BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+// 所有 new/delete 都经过这两个不内联的函数：编译器看不到 malloc/free 与 new/delete 直接配对
+// （否则 -Wall 下会报 -Wmismatched-new-delete），对齐分配也一并计数
+BENCH_NOINLINE static void* countedAlloc(size_t n, size_t align) {
+    if (g_counting) { ++g_allocs; g_allocBytes += n; }
+    if (n == 0) n = 1;
+    if (align <= alignof(std::max_align_t)) return std::malloc(n);
+#ifdef _WIN32
+    return _aligned_malloc(n, align);
+#else
+    void* p = nullptr;
+    return posix_memalign(&p, align, n) == 0 ? p : nullptr;
+#endif
+}
+
+BENCH_NOINLINE static void countedFree(void* p, size_t align) {
+#ifdef _WIN32
+    if (align > alignof(std::max_align_t)) { _aligned_free(p); return; }
+#endif
+    (void)align;
+    std::free(p);
+}
+
+static void* countedNew(size_t n, size_t align) {
+    if (void* p = countedAlloc(n, align)) return p;
+    throw std::bad_alloc();
+}
+
+const size_t DEFAULT_ALIGN = alignof(std::max_align_t);
+
+void* operator new(size_t n) { return countedNew(n, DEFAULT_ALIGN); }
+void* operator new[](size_t n) { return countedNew(n, DEFAULT_ALIGN); }
+void* operator new(size_t n, const std::nothrow_t&) noexcept { return countedAlloc(n, DEFAULT_ALIGN); }
+void* operator new[](size_t n, const std::nothrow_t&) noexcept { return countedAlloc(n, DEFAULT_ALIGN); }
+void operator delete(void* p) noexcept { countedFree(p, DEFAULT_ALIGN); }
+void operator delete[](void* p) noexcept { countedFree(p, DEFAULT_ALIGN); }
+void operator delete(void* p, size_t) noexcept { countedFree(p, DEFAULT_ALIGN); }
+void operator delete[](void* p, size_t) noexcept { countedFree(p, DEFAULT_ALIGN); }
+
+#ifdef __cpp_aligned_new
+// 超过默认对齐的分配（alignas 类型）
+void* operator new(size_t n, std::align_val_t a) { return countedNew(n, (size_t)a); }
+void* operator new[](size_t n, std::align_val_t a) { return countedNew(n, (size_t)a); }
+void* operator new(size_t n, std::align_val_t a, const std::nothrow_t&) noexcept { return countedAlloc(n, (size_t)a); }
+void* operator new[](size_t n, std::align_val_t a, const std::nothrow_t&) noexcept { return countedAlloc(n, (size_t)a); }
+void operator delete(void* p, std::align_val_t a) noexcept { countedFree(p, (size_t)a); }
+void operator delete[](void* p, std::align_val_t a) noexcept { countedFree(p, (size_t)a); }
+void operator delete(void* p, size_t, std::align_val_t a) noexcept { countedFree(p, (size_t)a); }
+void operator delete[](void* p, size_t, std::align_val_t a) noexcept { countedFree(p, (size_t)a); }
+#endif
+
+// 计时与分配计数一起暂停/恢复；另外自己累计计时区间的耗时用于 ns/node
+struct AllocMeter {
+    using Clock = std::chrono::steady_clock;
+
+    explicit AllocMeter(benchmark::State& s) : state(s) {}
+
+    void start() {
+        allocs0 = g_allocs;
+        bytes0 = g_allocBytes;
+        g_counting = true;
+        t0 = Clock::now();
+    }
+    void pause() {
+        elapsed += Clock::now() - t0;
+        state.PauseTiming();
+        g_counting = false;
+    }
+    void resume() {
+        g_counting = true;
+        state.ResumeTiming();
+        t0 = Clock::now();
+    }
+
+    // 写入计数器；nodes 为输入树的节点数
+    void finish(size_t nodes) {
+        elapsed += Clock::now() - t0;
+        g_counting = false;
+        using benchmark::Counter;
+        double iters = (double)state.iterations();
+        double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+        state.counters["allocs/op"] = Counter((double)(g_allocs - allocs0), Counter::kAvgIterations);
+        state.counters["bytes/op"] = Counter((double)(g_allocBytes - bytes0), Counter::kAvgIterations);
+        state.counters["ns/node"] = (iters > 0 && nodes > 0) ? ns / (iters * (double)nodes) : 0;
+        state.counters["nodes"] = (double)nodes;
+    }
+
+    benchmark::State& state;
+    size_t allocs0 = 0, bytes0 = 0;
+    Clock::time_point t0;
+    Clock::duration elapsed{ 0 };
+};
+
+// ===================== 表达式生成 =====================
+
+struct ExprSpec {
+    string shape = "random";
+    size_t nodes = 10000;
+    int vars = 4;
+    string ops = "+-*";      // 默认不含 /：随机树里常出现 33- 这样的零除数，求值会提前报错
+    string funcs = "sc";
+    unsigned seed = 1;
+};
+
+// 生成后缀表达式字符串；节点数按规格近似（无法恰好凑齐时相差 1）
+class ExprGen {
+public:
+    explicit ExprGen(const ExprSpec& s) : spec(s), rng(s.seed) {
+        for (int i = 0; i < spec.vars; ++i) {
+            if (i < 26) varTokens.push_back(string(1, (char)('a' + i)));
+            else varTokens.push_back("[v" + std::to_string(i + 1) + "]");
+        }
+    }
+
+    string generate() {
+        out.clear();
+        out.reserve(spec.nodes * 2);
+        if (spec.shape == "chain") chain();
+        else gen(spec.nodes < 1 ? 1 : spec.nodes, spec.shape == "balanced");
+        return out;
+    }
+
+private:
+    size_t pick(size_t n) { return std::uniform_int_distribution<size_t>(0, n - 1)(rng); }
+    bool chance(double p) { return std::uniform_real_distribution<double>(0, 1)(rng) < p; }
+
+    void leaf() {
+        if (!varTokens.empty() && chance(0.5)) {
+            const string& v = varTokens[pick(varTokens.size())];
+            // 单字母变量紧跟在同为字母的记号后可能拼成函数名，加空格隔开
+            if (v.size() == 1 && !out.empty() && out.back() >= 'a' && out.back() <= 'z') out += ' ';
+            out += v;
+        }
+        else out += (char)('1' + pick(9));
+    }
+    void op() { out += spec.ops[pick(spec.ops.size())]; }
+    void func() {
+        static const char* names[] = { "sin", "cos", "tan", "ln" };
+        char c = spec.funcs[pick(spec.funcs.size())];
+        out += names[c == 's' ? 0 : c == 'c' ? 1 : c == 't' ? 2 : 3];
+    }
+
+    // balanced 时左右子树各占一半；random 时随机切分并以 1/10 的概率插入一元函数
+    // 递归深度为树深，balanced/random 的树深为 O(log n)
+    void gen(size_t n, bool balanced) {
+        bool hasFunc = !spec.funcs.empty();
+        if (n == 1) { leaf(); return; }
+        if (n == 2 || spec.ops.empty() || (!balanced && hasFunc && chance(0.1))) {
+            if (hasFunc) { gen(n - 1, balanced); func(); }
+            else leaf();
+            return;
+        }
+        size_t left = balanced ? (n - 1) / 2 : 1 + pick(n - 2);
+        gen(left, balanced);
+        gen(n - 1 - left, balanced);
+        op();
+    }
+
+    // 左深链：x y op z op ...，每 10 步左右插入一个一元函数
+    void chain() {
+        leaf();
+        size_t n = 1;
+        while (n + 2 <= spec.nodes) {
+            if (!spec.funcs.empty() && chance(0.1)) { func(); ++n; continue; }
+            leaf();
+            op();
+            n += 2;
+        }
+    }
+
+    ExprSpec spec;
+    std::mt19937 rng;
+    vector<string> varTokens;
+    string out;
+};
+
+// 生成好的表达式及其统计信息
+struct Workload {
+    ExprSpec spec;
+    string postfix;
+    ExprTree tree;
+    std::map<char, double> vars;
+    size_t nodes = 0;
+    size_t depth = 0;
+};
+
+static void measureTree(Node* root, size_t& nodes, size_t& depth) {
+    nodes = depth = 0;
+    vector<std::pair<Node*, size_t>> st;
+    if (root) st.push_back({ root, 1 });
+    while (!st.empty()) {
+        Node* p = st.back().first;
+        size_t d = st.back().second;
+        st.pop_back();
+        ++nodes;
+        if (d > depth) depth = d;
+        if (p->l) st.push_back({ p->l, d + 1 });
+        if (p->r) st.push_back({ p->r, d + 1 });
+    }
+}
+
+static bool makeWorkload(const ExprSpec& spec, Workload& w) {
+    w.spec = spec;
+    w.postfix = ExprGen(spec).generate();
+    string err;
+    if (!w.tree.buildFromPostfixChars(w.postfix, &err)) {
+        std::fprintf(stderr, "generated expression does not parse (shape %s, nodes %zu)\n",
+            spec.shape.c_str(), spec.nodes);
+        return false;
+    }
+    // 变量取不同的非整数值，避免 x-x 之类恰好为 0 的除数过于常见
+    int i = 0;
+    for (char c : w.tree.collectVars()) w.vars[c] = 0.37 + 0.11 * (i++);
+    measureTree(w.tree.root, w.nodes, w.depth);
+    return true;
+}
+
+// ===================== 基准 =====================
+
+static void BM_build(benchmark::State& state, const Workload* w) {
+    AllocMeter m(state);
+    m.start();
+    for (auto _ : state) {
+        ExprTree T;
+        string err;
+        bool ok = T.buildFromPostfixChars(w->postfix, &err);
+        benchmark::DoNotOptimize(ok);
+    }
+    m.finish(w->nodes);
+}
+
+static void BM_toPostfix(benchmark::State& state, const Workload* w) {
+    AllocMeter m(state);
+    m.start();
+    for (auto _ : state) {
+        string s = w->tree.toPostfix();
+        benchmark::DoNotOptimize(s.data());
+    }
+    m.finish(w->nodes);
+}
+
+static void BM_toInfix(benchmark::State& state, const Workload* w) {
+    AllocMeter m(state);
+    m.start();
+    for (auto _ : state) {
+        string s = w->tree.toInfix();
+        benchmark::DoNotOptimize(s.data());
+    }
+    m.finish(w->nodes);
+}
+
+static void BM_collectVars(benchmark::State& state, const Workload* w) {
+    AllocMeter m(state);
+    m.start();
+    for (auto _ : state) {
+        std::set<char> vs = w->tree.collectVars();
+        benchmark::DoNotOptimize(vs.size());
+    }
+    m.finish(w->nodes);
+}
+
+static void BM_eval(benchmark::State& state, const Workload* w) {
+    AllocMeter m(state);
+    double v = 0;
+    bool ok = true;
+    string err;
+    m.start();
+    for (auto _ : state) {
+        ok = w->tree.eval(w->vars, v, &err);
+        benchmark::DoNotOptimize(v);
+    }
+    m.finish(w->nodes);
+    if (!ok) state.SetLabel("eval stops early on an error");
+}
+
+// 区间求值：每个变量取 [值-0.5, 值+0.5]，编译不计时
+static void BM_evalInterval(benchmark::State& state, const Workload* w) {
+    CompiledExpr C;
+    C.compile(w->tree);
+    vector<Interval> box;
+    for (char v : C.slotVars) {
+        double x = w->vars.at(v);
+        box.push_back({ x - 0.5, x + 0.5 });
+    }
+    Interval r;
+    unsigned char flags = IV_OK;
+    AllocMeter m(state);
+    m.start();
+    for (auto _ : state) {
+        flags = evalInterval(C, box.data(), r);
+        benchmark::DoNotOptimize(r);
+    }
+    m.finish(w->nodes);
+    if (flags & IV_ALWAYS_FAIL) state.SetLabel("fails everywhere in the box");
+}
+
+// 堆上逐节点复制；释放不计时
+static void BM_cloneTree(benchmark::State& state, const Workload* w) {
+    AllocMeter m(state);
+    m.start();
+    for (auto _ : state) {
+        Node* c = cloneTree(w->tree.root);
+        m.pause();
+        freeTree(c);
+        m.resume();
+    }
+    m.finish(w->nodes);
+}
+
+// 堆上逐节点释放；复制不计时
+static void BM_freeTree(benchmark::State& state, const Workload* w) {
+    AllocMeter m(state);
+    m.start();
+    for (auto _ : state) {
+        m.pause();
+        Node* c = cloneTree(w->tree.root);
+        m.resume();
+        freeTree(c);
+    }
+    m.finish(w->nodes);
+}
+
+// 与 DerivativeTree 相同，导数节点分配在 arena 上；arena 回收不计时
+static void BM_derivNode(benchmark::State& state, const Workload* w) {
+    AllocMeter m(state);
+    NodeArena arena;
+    NodeArenaScope scope(&arena);
+    char var = w->vars.empty() ? 'a' : w->vars.begin()->first;
+    string err;
+    m.start();
+    for (auto _ : state) {
+        Node* d = derivNode(w->tree.root, var, &err);
+        benchmark::DoNotOptimize(d);
+        m.pause();
+        arena.reset();
+        m.resume();
+    }
+    m.finish(w->nodes);
+}
+
+// 前向模式自动微分：一次遍历求值和对第一个变量的偏导（对比 derivNode 生成导数树）
+static void BM_evalDerivative(benchmark::State& state, const Workload* w) {
+    AllocMeter m(state);
+    char var = w->vars.empty() ? 'a' : w->vars.begin()->first;
+    double v = 0, d = 0;
+    bool ok = true;
+    string err;
+    m.start();
+    for (auto _ : state) {
+        ok = evalDerivative(w->tree, w->vars, var, v, d, &err);
+        benchmark::DoNotOptimize(d);
+    }
+    m.finish(w->nodes);
+    if (!ok) state.SetLabel("stops early on an error");
+}
+
+// 反向模式：一次前向 + 一次反向得到全部偏导数，建带不计时
+static void BM_gradientTape(benchmark::State& state, const Workload* w) {
+    CompiledExpr C;
+    C.compile(w->tree);
+    GradientTape tape;
+    tape.build(C);
+    vector<double> slots;
+    for (char v : C.slotVars) slots.push_back(w->vars.at(v));
+    vector<double> grad(slots.size());
+    double v = 0;
+    bool ok = true;
+    AllocMeter m(state);
+    m.start();
+    for (auto _ : state) {
+        ok = tape.gradient(slots.data(), v, grad.data(), nullptr);
+        benchmark::DoNotOptimize(grad.data());
+    }
+    m.finish(w->nodes);
+    if (!ok) state.SetLabel("stops early on an error");
+}
+
+// 符号梯度：全部偏导共享一个仓库，dagNodes 为全部偏导合计的不同节点数
+static void BM_gradientTree(benchmark::State& state, const Workload* w) {
+    GradientTree G;
+    bool ok = true;
+    AllocMeter m(state);
+    m.start();
+    for (auto _ : state) {
+        ok = G.build(w->tree, nullptr);
+        benchmark::DoNotOptimize(G.rows());
+    }
+    m.finish(w->nodes);
+    state.counters["dagNodes"] = ok ? (double)G.nodeCount() : 0;
+    if (!ok) state.SetLabel("derivative failed");
+}
+
+// Hessian：二阶偏导按 (子表达式, 变量) 记忆，dagNodes 为全部二阶偏导合计的不同节点数
+static void BM_hessianTree(benchmark::State& state, const Workload* w) {
+    HessianTree H;
+    bool ok = true;
+    AllocMeter m(state);
+    m.start();
+    for (auto _ : state) {
+        ok = H.build(w->tree, nullptr);
+        benchmark::DoNotOptimize(H.vars().size());
+    }
+    m.finish(w->nodes);
+    state.counters["dagNodes"] = ok ? (double)H.nodeCount() : 0;
+    if (!ok) state.SetLabel("derivative failed");
+}
+
+// 化简会修改树，每次先在 arena 上复制一份（不计时）
+static void BM_simplifyNode(benchmark::State& state, const Workload* w) {
+    AllocMeter m(state);
+    NodeArena arena;
+    NodeArenaScope scope(&arena);
+    m.start();
+    for (auto _ : state) {
+        m.pause();
+        arena.reset();
+        Node* c = cloneTree(w->tree.root);
+        m.resume();
+        c = simplifyNode(c);
+        benchmark::DoNotOptimize(c);
+    }
+    m.finish(w->nodes);
+}
+
+static void BM_layoutTree(benchmark::State& state, const Workload* w) {
+    AllocMeter m(state);
+    m.start();
+    for (auto _ : state) {
+        Layout L = layoutTree(w->tree.root, 400, 60, 60, 80, 700, 350);
+        benchmark::DoNotOptimize(L.x.data());
+    }
+    m.finish(w->nodes);
+}
+
+static void BM_layoutTidy(benchmark::State& state, const Workload* w) {
+    TidyLayout tidy;
+    AllocMeter m(state);
+    m.start();
+    for (auto _ : state) {
+        Layout L = tidy.layout(w->tree.root, 400, 60, 44, 60, 700, 350);
+        benchmark::DoNotOptimize(L.x.data());
+    }
+    m.finish(w->nodes);
+}
+
+// 紧凑布局的增量重排：每次包裹一个随机子树后只重算它到根的路径（包裹本身不计时）
+static void BM_relayoutTidy(benchmark::State& state, const Workload* w) {
+    ExprTree T = w->tree.clone();
+    TidyLayout tidy;
+    Layout L = tidy.layout(T.root, 400, 60, 44, 60, 700, 350);
+    std::mt19937 rng(7);
+
+    AllocMeter m(state);
+    m.start();
+    for (auto _ : state) {
+        m.pause();
+        Node* target = L.nodes[rng() % L.size()];
+        tidy.invalidate(target);
+        T.wrapSubtree(target, 's');
+        m.resume();
+        L = tidy.relayout(T.root, 400, 60, 44, 60, 700, 350);
+        benchmark::DoNotOptimize(L.x.data());
+    }
+    m.finish(w->nodes);
+    T.clear();
+}
+
+// 局部修改：把随机选中的子树包成 sin(...)，后缀/中缀缓存增量更新（首次修改建立索引，不计时）
+static void BM_wrapSubtree(benchmark::State& state, const Workload* w) {
+    ExprTree T = w->tree.clone();
+    vector<Node*> nodes;
+    vector<Node*> st{ T.root };
+    while (!st.empty()) {
+        Node* p = st.back();
+        st.pop_back();
+        nodes.push_back(p);
+        if (p->l) st.push_back(p->l);
+        if (p->r) st.push_back(p->r);
+    }
+    T.wrapSubtree(T.root, 's');
+    std::mt19937 rng(7);
+
+    AllocMeter m(state);
+    m.start();
+    for (auto _ : state) {
+        bool ok = T.wrapSubtree(nodes[rng() % nodes.size()], 's');
+        benchmark::DoNotOptimize(ok);
+    }
+    m.finish(w->nodes);
+    T.clear();
+}
+
+// 保留旧版本的局部修改：先复制根到随机叶子的路径再包裹，旧根全部保留（与撤销快照共享节点）
+static void BM_copyPathWrap(benchmark::State& state, const Workload* w) {
+    ExprTree T = w->tree.clone();
+    vector<Node*> leaves;   // 叶子不在任何被复制的路径上，始终属于当前版本
+    vector<Node*> st{ T.root };
+    while (!st.empty()) {
+        Node* p = st.back();
+        st.pop_back();
+        if (!p->l) leaves.push_back(p);
+        if (p->l) st.push_back(p->l);
+        if (p->r) st.push_back(p->r);
+    }
+    T.wrapSubtree(T.root, 's');
+    vector<Node*> versions;
+    std::mt19937 rng(7);
+
+    AllocMeter m(state);
+    m.start();
+    for (auto _ : state) {
+        Node* target = leaves[rng() % leaves.size()];
+        versions.push_back(T.root);
+        bool ok = T.copyPath(target) && T.wrapSubtree(target, 's');
+        benchmark::DoNotOptimize(ok);
+    }
+    m.finish(w->nodes);
+    T.clear();
+}
+
+// ===================== 注册与入口 =====================
+
+static bool parseSpec(const string& text, ExprSpec& spec) {
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t comma = text.find(',', pos);
+        if (comma == string::npos) comma = text.size();
+        string item = text.substr(pos, comma - pos);
+        pos = comma + 1;
+        size_t colon = item.find(':');
+        if (colon == string::npos) return false;
+        string key = item.substr(0, colon), val = item.substr(colon + 1);
+        if (key == "shape") {
+            if (val != "balanced" && val != "random" && val != "chain") return false;
+            spec.shape = val;
+        }
+        else if (key == "nodes") spec.nodes = (size_t)std::strtoull(val.c_str(), nullptr, 10);
+        else if (key == "vars") spec.vars = std::atoi(val.c_str());
+        else if (key == "ops") {
+            for (char c : val) if (!isOp(c)) return false;
+            spec.ops = val;
+        }
+        else if (key == "funcs") {
+            for (char c : val) if (!std::strchr("sctl", c)) return false;
+            spec.funcs = val;
+        }
+        else if (key == "seed") spec.seed = (unsigned)std::strtoul(val.c_str(), nullptr, 10);
+        else return false;
+    }
+    return spec.nodes > 0 && spec.vars >= 0 && spec.vars <= 26 + VAR_CODE_MAX;
+}
+
+static void registerAll(const Workload* w) {
+    string base = "/" + w->spec.shape + "/" + std::to_string(w->nodes) + "/v" + std::to_string(w->spec.vars);
+    struct Entry { const char* name; void (*fn)(benchmark::State&, const Workload*); };
+    static const Entry entries[] = {
+        { "build", BM_build }, { "toPostfix", BM_toPostfix }, { "toInfix", BM_toInfix },
+        { "collectVars", BM_collectVars }, { "eval", BM_eval }, { "evalInterval", BM_evalInterval },
+        { "cloneTree", BM_cloneTree },
+        { "freeTree", BM_freeTree }, { "derivNode", BM_derivNode }, { "evalDerivative", BM_evalDerivative },
+        { "gradientTape", BM_gradientTape }, { "gradientTree", BM_gradientTree },
+        { "hessianTree", BM_hessianTree }, { "simplifyNode", BM_simplifyNode },
+        { "layoutTree", BM_layoutTree }, { "layoutTidy", BM_layoutTidy }, { "relayoutTidy", BM_relayoutTidy },
+        { "wrapSubtree", BM_wrapSubtree }, { "copyPathWrap", BM_copyPathWrap },
+    };
+    for (const Entry& e : entries) {
+        benchmark::RegisterBenchmark((e.name + base).c_str(), e.fn, w)->Unit(benchmark::kMicrosecond);
+    }
+}
+
+int main(int argc, char** argv) {
+    // 先取出本程序自己的 --expr 参数，其余交给 Google Benchmark
+    vector<ExprSpec> specs;
+    int kept = 1;
+    for (int i = 1; i < argc; ++i) {
+        string a = argv[i];
+        if (a.compare(0, 7, "--expr=") == 0) {
+            ExprSpec s;
+            if (!parseSpec(a.substr(7), s)) {
+                std::fprintf(stderr, "bad --expr spec: %s\n", a.c_str());
+                return 1;
+            }
+            specs.push_back(s);
+        }
+        else argv[kept++] = argv[i];
+    }
+    argc = kept;
+
+    if (specs.empty()) {
+        // 链上的求导和化简是平方复杂度（每层都复制整棵子树），链只取较小的规模
+        const size_t sizes[] = { 1 << 10, 1 << 14, 1 << 17 };
+        const size_t chainSizes[] = { 1 << 10, 1 << 13 };
+        for (const char* sh : { "balanced", "random" }) {
+            for (size_t n : sizes) {
+                ExprSpec s;
+                s.shape = sh;
+                s.nodes = n;
+                specs.push_back(s);
+            }
+        }
+        for (size_t n : chainSizes) {
+            ExprSpec s;
+            s.shape = "chain";
+            s.nodes = n;
+            specs.push_back(s);
+        }
+    }
+
+    // Workload 在注册后必须保持地址不变
+    vector<std::unique_ptr<Workload>> loads;
+    for (const ExprSpec& s : specs) {
+        std::unique_ptr<Workload> w(new Workload);
+        if (!makeWorkload(s, *w)) return 1;
+        benchmark::AddCustomContext("expr" + std::to_string(loads.size()),
+            "shape:" + s.shape + ",nodes:" + std::to_string(w->nodes) + ",depth:" + std::to_string(w->depth) +
+            ",vars:" + std::to_string(s.vars) + ",ops:" + s.ops + ",funcs:" + s.funcs +
+            ",seed:" + std::to_string(s.seed));
+        registerAll(w.get());
+        loads.push_back(std::move(w));
+    }
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
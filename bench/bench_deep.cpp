@@ -0,0 +1,83 @@
+﻿// 深表达式基准：链式后缀表达式 a1+1+1+...（左深链，树深 = 节点数 / 2）
+// 用法：bench_deep [链长，默认 1000000]
+// 输出每种树算法的耗时和吞吐量（百万节点/秒）
+
+#include "ppe.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using Clock = std::chrono::steady_clock;
+
+static double msSince(Clock::time_point t0) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+static void report(const char* name, double ms, size_t nodes) {
+    std::printf("%-14s %10.2f ms %10.1f Mnode/s\n", name, ms, nodes / ms / 1000.0);
+}
+
+int main(int argc, char** argv) {
+    size_t depth = argc > 1 ? (size_t)std::strtoull(argv[1], nullptr, 10) : 1000000;
+    size_t nodes = depth * 2 + 1;
+
+    string src = "a";
+    src.reserve(depth * 2 + 1);
+    for (size_t i = 0; i < depth; ++i) src += "1+";
+
+    std::printf("depth %zu, %zu nodes\n", depth, nodes);
+
+    ExprTree T;
+    string err;
+    auto t0 = Clock::now();
+    if (!T.buildFromPostfixChars(src, &err)) {
+        std::printf("build failed: %s\n", err.c_str());
+        return 1;
+    }
+    report("build+infix", msSince(t0), nodes);
+
+    t0 = Clock::now();
+    string post = T.toPostfix();
+    report("toPostfix", msSince(t0), nodes);
+
+    t0 = Clock::now();
+    string in = T.toInfix();
+    report("toInfix", msSince(t0), nodes);
+
+    t0 = Clock::now();
+    std::set<char> vars = T.collectVars();
+    report("collectVars", msSince(t0), nodes);
+
+    double v = 0;
+    t0 = Clock::now();
+    bool ok = T.eval({ { 'a', 0.5 } }, v, &err);
+    report("eval", msSince(t0), nodes);
+
+    t0 = Clock::now();
+    ExprTree C = T.clone();
+    report("clone", msSince(t0), nodes);
+
+    t0 = Clock::now();
+    bool eq = treesEqual(T.root, C.root);
+    report("treesEqual", msSince(t0), nodes);
+
+    t0 = Clock::now();
+    ExprTree D = DerivativeTree(T, 'a', &err);
+    report("derivative", msSince(t0), nodes);
+
+    t0 = Clock::now();
+    C.simplify();
+    report("simplify", msSince(t0), nodes);
+
+    // 堆上的树逐节点释放
+    Node* heap = cloneTree(T.root);
+    t0 = Clock::now();
+    freeTree(heap);
+    report("freeTree(heap)", msSince(t0), nodes);
+
+    std::printf("check: postfix %s, vars %zu, eval %s = %.17g, equal %d, simplified %s\n",
+        post == src ? "ok" : "MISMATCH", vars.size(), ok ? "ok" : err.c_str(), v, (int)eq,
+        C.infixCache.c_str());
+    return (post == src && ok && eq && in.size() > nodes) ? 0 : 1;
+}
@@ -0,0 +1,326 @@
+﻿// 命令行驱动：不依赖 EasyX / Win32，可在无显示的服务器上用于批处理和基准测试
+// 用法见 usage()；表达式语法与图形界面相同（见 README）
+
+#include "ppe.h"
+#include "ppe_stream.h"
+#include "ppe_dag.h"
+#include "ppe_interval.h"
+#include "ppe_autodiff.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef _WIN32
+#include <iconv.h>
+#endif
+
+// 退出码
+enum {
+    EXIT_OK = 0,       // 成功
+    EXIT_EXPR = 1,     // 表达式错误（解析/求值/求导失败，或流式输入中有记录失败）
+    EXIT_USAGE = 2,    // 参数错误或无法读取输入
+};
+
+static void usage() {
+    std::fputs(
+        "usage: ppe_cli <command> [options] [args]\n"
+        "\n"
+        "commands:\n"
+        "  build    <postfix>                   parse and print the normalized postfix\n"
+        "  infix    <postfix>                   print the infix form\n"
+        "  eval     <postfix> [name=value ...]  evaluate with the given variables\n"
+        "  bound    <postfix> [name=lo:hi ...]  bound the value over variable ranges\n"
+        "  grad     <postfix> [name=value ...]  value and partial derivatives at a point\n"
+        "  derive   <postfix> [var ...]         partial derivative with respect to each var in turn\n"
+        "                                       (all first partials if omitted)\n"
+        "  simplify <postfix>                   simplify\n"
+        "  compose  <postfix1> <postfix2> <op>  build (E1) op (E2)\n"
+        "  stream   [file|-] [name=value ...]   evaluate one postfix expression per line\n"
+        "\n"
+        "options:\n"
+        "  -p, --postfix   print derive/simplify/compose results as postfix (default: infix)\n"
+        "  -s, --simplify  simplify the derivative\n"
+        "  --mmap          stream: memory-map the input file\n"
+        "\n"
+        "Variable names are single letters or identifiers such as x1 and rate\n"
+        "(written [x1] inside postfix). Exit status: 0 ok, 1 expression error, 2 usage.\n",
+        stderr);
+}
+
+// 引擎的报错信息是 GBK 编码；非 Windows 平台转成 UTF-8 再输出，转换失败时原样输出
+static string consoleText(const string& s) {
+#ifdef _WIN32
+    return s;
+#else
+    static iconv_t cd = iconv_open("UTF-8", "GBK");
+    if (cd == (iconv_t)-1) return s;
+    iconv(cd, nullptr, nullptr, nullptr, nullptr);
+    string out(s.size() * 2 + 4, '\0');
+    char* in = const_cast<char*>(s.data());
+    size_t inLeft = s.size();
+    char* dst = &out[0];
+    size_t outLeft = out.size();
+    if (iconv(cd, &in, &inLeft, &dst, &outLeft) == (size_t)-1) return s;
+    out.resize(out.size() - outLeft);
+    return out;
+#endif
+}
+
+static int fail(const string& err) {
+    std::fprintf(stderr, "error: %s\n", consoleText(err).c_str());
+    return EXIT_EXPR;
+}
+
+static void printNumber(double v) {
+    char buf[32];
+    formatNumberExact(v, buf, sizeof(buf));
+    std::printf("%s\n", buf);
+}
+
+// 变量名：单字母或标识符，允许写成 [name]
+static bool parseVarName(const string& s, char& code) {
+    string name = s;
+    if (name.size() >= 2 && name.front() == '[' && name.back() == ']')
+        name = name.substr(1, name.size() - 2);
+    if (!isIdentifier(name.data(), name.size())) return false;
+    code = varCodeFromName(name);
+    return code != 0;
+}
+
+// 变量赋值：name=value
+static bool parseAssign(const string& s, std::map<char, double>& vars) {
+    size_t eq = s.find('=');
+    if (eq == string::npos || eq + 1 == s.size()) return false;
+    char code;
+    if (!parseVarName(s.substr(0, eq), code)) return false;
+    const char* num = s.c_str() + eq + 1;
+    char* end = nullptr;
+    double v = std::strtod(num, &end);
+    if (end == num || *end) return false;
+    vars[code] = v;
+    return true;
+}
+
+// 变量范围：name=lo:hi，或 name=value 表示单点
+static bool parseRange(const string& s, std::map<char, Interval>& vars) {
+    size_t eq = s.find('=');
+    if (eq == string::npos || eq + 1 == s.size()) return false;
+    char code;
+    if (!parseVarName(s.substr(0, eq), code)) return false;
+    const char* num = s.c_str() + eq + 1;
+    char* end = nullptr;
+    double lo = std::strtod(num, &end);
+    if (end == num) return false;
+    double hi = lo;
+    if (*end == ':') {
+        const char* num2 = end + 1;
+        hi = std::strtod(num2, &end);
+        if (end == num2) return false;
+    }
+    if (*end || !(lo <= hi)) return false;
+    vars[code] = { lo, hi };
+    return true;
+}
+
+static bool build(const string& src, ExprTree& T) {
+    string err;
+    if (T.buildFromPostfixChars(src, &err)) return true;
+    fail(err);
+    return false;
+}
+
+static void printTree(const ExprTree& T, bool postfix) {
+    std::printf("%s\n", postfix ? T.toPostfix().c_str() : T.toInfix().c_str());
+}
+
+static int runStream(const vector<string>& args, bool useMmap) {
+    string path = "-";
+    std::map<char, double> vars;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i].find('=') != string::npos) {
+            if (!parseAssign(args[i], vars)) {
+                std::fprintf(stderr, "bad assignment: %s\n", args[i].c_str());
+                return EXIT_USAGE;
+            }
+        }
+        else if (i == 0) path = args[i];
+        else { usage(); return EXIT_USAGE; }
+    }
+
+    // 结果每行一个，失败的记录输出 nan 保持行对齐，错误信息写到 stderr
+    static char outBuf[1 << 16];
+    std::setvbuf(stdout, outBuf, _IOFBF, sizeof(outBuf));
+
+    StreamStats stats;
+    string err;
+    bool ok = streamEvalFile(path, useMmap, vars,
+        [](const StreamRecord& rec, bool good, double v, const string& e) {
+            if (good) {
+                char buf[32];
+                int n = formatNumberExact(v, buf, sizeof(buf));
+                buf[n] = '\n';
+                std::fwrite(buf, 1, (size_t)n + 1, stdout);
+            }
+            else {
+                std::fputs("nan\n", stdout);
+                std::fprintf(stderr, "line %zu: %s\n", rec.line, consoleText(e).c_str());
+            }
+            return true;
+        },
+        &stats, &err);
+    std::fflush(stdout);
+    if (!ok) {
+        std::fprintf(stderr, "error: %s\n", consoleText(err).c_str());
+        return EXIT_USAGE;
+    }
+    return stats.failed ? EXIT_EXPR : EXIT_OK;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) { usage(); return EXIT_USAGE; }
+    string cmd = argv[1];
+
+    bool postfix = false, simplify = false, useMmap = false;
+    vector<string> args;
+    for (int i = 2; i < argc; ++i) {
+        string a = argv[i];
+        if (a == "-p" || a == "--postfix") postfix = true;
+        else if (a == "-s" || a == "--simplify") simplify = true;
+        else if (a == "--mmap") useMmap = true;
+        else args.push_back(a);
+    }
+
+    if (cmd == "-h" || cmd == "--help" || cmd == "help") { usage(); return EXIT_OK; }
+
+    if (cmd == "stream") return runStream(args, useMmap);
+
+    if (cmd != "build" && cmd != "infix" && cmd != "eval" && cmd != "bound" && cmd != "grad" &&
+        cmd != "derive" && cmd != "simplify" && cmd != "compose") {
+        std::fprintf(stderr, "unknown command: %s\n", cmd.c_str());
+        usage();
+        return EXIT_USAGE;
+    }
+
+    if (args.empty()) { usage(); return EXIT_USAGE; }
+    ExprTree T;
+
+    if (cmd == "build" || cmd == "infix" || cmd == "simplify") {
+        if (args.size() != 1) { usage(); return EXIT_USAGE; }
+        if (!build(args[0], T)) return EXIT_EXPR;
+        if (cmd == "simplify") T.simplify();
+        printTree(T, cmd == "build" || (cmd == "simplify" && postfix));
+        return EXIT_OK;
+    }
+
+    if (cmd == "eval") {
+        std::map<char, double> vars;
+        for (size_t i = 1; i < args.size(); ++i) {
+            if (!parseAssign(args[i], vars)) {
+                std::fprintf(stderr, "bad assignment: %s\n", args[i].c_str());
+                return EXIT_USAGE;
+            }
+        }
+        if (!build(args[0], T)) return EXIT_EXPR;
+        double v = 0;
+        string err;
+        if (!T.eval(vars, v, &err)) return fail(err);
+        printNumber(v);
+        return EXIT_OK;
+    }
+
+    if (cmd == "bound") {
+        std::map<char, Interval> vars;
+        for (size_t i = 1; i < args.size(); ++i) {
+            if (!parseRange(args[i], vars)) {
+                std::fprintf(stderr, "bad range: %s\n", args[i].c_str());
+                return EXIT_USAGE;
+            }
+        }
+        if (!build(args[0], T)) return EXIT_EXPR;
+        Interval r;
+        unsigned char flags = IV_OK;
+        string err;
+        if (!evalInterval(T, vars, r, &flags, &err)) return fail(err);
+        if (flags & IV_ALWAYS_FAIL) {
+            std::fprintf(stderr, "error: evaluation fails everywhere in the given ranges\n");
+            return EXIT_EXPR;
+        }
+        char lo[32], hi[32];
+        formatNumberExact(r.lo, lo, sizeof(lo));
+        formatNumberExact(r.hi, hi, sizeof(hi));
+        std::printf("[%s, %s]\n", lo, hi);
+        if (flags & IV_DIV_ZERO) std::fprintf(stderr, "warning: division by zero is possible in these ranges\n");
+        if (flags & IV_LN_DOMAIN) std::fprintf(stderr, "warning: ln of a non-positive value is possible in these ranges\n");
+        return EXIT_OK;
+    }
+
+    if (cmd == "grad") {
+        std::map<char, double> vars;
+        for (size_t i = 1; i < args.size(); ++i) {
+            if (!parseAssign(args[i], vars)) {
+                std::fprintf(stderr, "bad assignment: %s\n", args[i].c_str());
+                return EXIT_USAGE;
+            }
+        }
+        if (!build(args[0], T)) return EXIT_EXPR;
+        double v = 0;
+        std::map<char, double> grad;
+        string err;
+        if (!evalGradient(T, vars, v, grad, &err)) return fail(err);
+        printNumber(v);
+        for (const auto& kv : grad) {
+            char buf[32];
+            formatNumberExact(kv.second, buf, sizeof(buf));
+            std::printf("d/d%s = %s\n", varNameFromCode(kv.first).c_str(), buf);
+        }
+        return EXIT_OK;
+    }
+
+    if (cmd == "derive" && args.size() == 1) {
+        if (!build(args[0], T)) return EXIT_EXPR;
+        GradientTree G;
+        string err;
+        if (!G.build(T, &err)) return fail(err);
+        if (simplify) G.simplify();   // 在 DAG 上化简，各偏导共享的子表达式只化简一次
+        for (size_t i = 0; i < G.vars().size(); ++i) {
+            ExprTree D = G.partialTree(0, i);
+            std::printf("d/d%s = %s\n", varNameFromCode(G.vars()[i]).c_str(),
+                postfix ? D.toPostfix().c_str() : D.toInfix().c_str());
+        }
+        return EXIT_OK;
+    }
+
+    if (cmd == "derive") {
+        vector<char> vars;
+        for (size_t i = 1; i < args.size(); ++i) {
+            char var;
+            if (!parseVarName(args[i], var)) {
+                std::fprintf(stderr, "bad variable name: %s\n", args[i].c_str());
+                return EXIT_USAGE;
+            }
+            vars.push_back(var);
+        }
+        if (!build(args[0], T)) return EXIT_EXPR;
+        string err;
+        // 高阶/混合偏导在共享子表达式的 DAG 上逐次求导
+        ExprTree D = vars.size() == 1 ? DerivativeTree(T, vars[0], &err) : MixedPartialTree(T, vars, &err);
+        if (!D.root) return fail(err);
+        if (simplify) D.simplify();
+        printTree(D, postfix);
+        return EXIT_OK;
+    }
+
+    if (cmd == "compose") {
+        if (args.size() != 3 || args[2].size() != 1) { usage(); return EXIT_USAGE; }
+        ExprTree E2;
+        if (!build(args[0], T) || !build(args[1], E2)) return EXIT_EXPR;
+        string err;
+        ExprTree R = Compose(T, E2, args[2][0], &err);
+        if (!R.root) return fail(err);
+        printTree(R, postfix);
+        return EXIT_OK;
+    }
+
+    return EXIT_USAGE;
+}
@@ -0,0 +1,526 @@
+﻿// 核心算法的随机化一致性测试（由 ctest 运行）
+// 用法：test_core [种子，默认 1] [表达式个数，默认 400]
+// 随机生成后缀表达式（含多字符变量名、任意数字字面量、-0、一元函数和会触发求值错误的子式），逐项对照：
+//   compile      CompiledExpr::eval 与 ExprTree::eval 的值逐位一致，报错信息相同
+//   cse          compileCse 与 compile 的值逐位一致，报错信息相同
+//   batch        evalBatch / evalBatchParallel 每行与 eval 逐位一致，LaneStatus 与报错种类对应
+//   interval     区间内采样点上 eval 的结果落在包围区间内，诊断标志覆盖实际出现的错误
+//   gradient     evalDerivative / evalDual / GradientTape 与 DerivativeTree 的求值一致
+//   dag          dagEval 与 eval 逐位一致；dagDerivative / dagSimplify 与树上的 derivNode / simplify 导入同一仓库后是同一个节点
+//   higher       HessianTree / MixedPartialTree / NthDerivativeTree 与逐次 DerivativeTree 相同，GradientTree 与 DerivativeTree 的求值一致
+//   postfix      toPostfix 输出重新解析后得到相同的后缀串、中缀串和值
+//   stream       streamPostfix / streamPostfixFile 的统计与报错行号，记录数超过名字表容量时仍全部解析
+//   pool         线程池嵌套调用和异常传递
+// 有失败时打印前若干条并以非 0 退出
+
+#include "ppe_parallel.h"
+#include "ppe_interval.h"
+#include "ppe_autodiff.h"
+#include "ppe_stream.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <stdexcept>
+
+// ===================== 检查与报告 =====================
+
+static size_t g_checks = 0;
+static size_t g_failures = 0;
+
+static bool check(bool ok, const char* section, const string& detail) {
+    ++g_checks;
+    if (!ok) {
+        ++g_failures;
+        if (g_failures <= 20) std::printf("FAIL [%s] %s\n", section, detail.c_str());
+    }
+    return ok;
+}
+
+static string fmt(double v) {
+    char buf[NUMBER_BUF_SIZE];
+    formatNumberExact(v, buf, sizeof buf);
+    return buf;
+}
+
+// 值逐位相同（区分 -0 与 0，NaN 视为相同）
+static bool sameValue(double a, double b) {
+    if (a != a || b != b) return a != a && b != b;
+    return a == b && std::signbit(a) == std::signbit(b);
+}
+
+static bool closeValue(double a, double b, double rel) {
+    return std::fabs(a - b) <= rel * (1 + (std::max)(std::fabs(a), std::fabs(b)));
+}
+
+// eval 报错信息取自引擎本身（头文件的字符串编码与本文件无关）
+static string g_divZeroMsg, g_lnDomainMsg;
+
+static void loadErrorMessages() {
+    ExprTree T;
+    double v;
+    T.buildFromPostfixChars("10/", nullptr);
+    T.eval({}, v, &g_divZeroMsg);
+    T.buildFromPostfixChars("0 ln", nullptr);
+    T.eval({}, v, &g_lnDomainMsg);
+}
+
+static unsigned char laneFromError(const string& err) {
+    if (err == g_divZeroMsg) return LANE_DIV_ZERO;
+    if (err == g_lnDomainMsg) return LANE_LN_DOMAIN;
+    return LANE_FAIL;
+}
+
+// ===================== 表达式与取值生成 =====================
+
+class RandomExpr {
+public:
+    explicit RandomExpr(unsigned seed) : rng(seed) {}
+
+    // 约 nodes 个节点的后缀表达式，记号之间用空格隔开
+    string postfix(size_t nodes) {
+        out.clear();
+        gen(nodes < 1 ? 1 : nodes);
+        return out;
+    }
+
+    // 每个变量取一个值；常出现 0、±1 等会触发除零/ln 定义域错误的值
+    double value() {
+        static const double special[] = { 0.0, -0.0, 1.0, -1.0, 0.5, 2.0 };
+        if (chance(0.2)) return special[pick(6)];
+        return std::uniform_real_distribution<double>(-3, 3)(rng);
+    }
+
+    size_t pick(size_t n) { return std::uniform_int_distribution<size_t>(0, n - 1)(rng); }
+    bool chance(double p) { return std::uniform_real_distribution<double>(0, 1)(rng) < p; }
+
+    std::mt19937 rng;
+
+private:
+    void token(const char* t) {
+        if (!out.empty()) out += ' ';
+        out += t;
+    }
+
+    void leaf() {
+        static const char* vars[] = { "a", "b", "c", "[x1]", "[rate]" };
+        static const char* nums[] = { "0", "1", "2", "7", "[2.5]", "[-0]", "[-1.25]", "[1e-3]", "[3.141592653589793]" };
+        if (chance(0.6)) token(vars[pick(5)]);
+        else token(nums[pick(9)]);
+    }
+
+    void gen(size_t n) {
+        static const char* ops[] = { "+", "-", "*", "/", "^" };
+        static const char* funcs[] = { "sin", "cos", "tan", "ln" };
+        if (n == 1) { leaf(); return; }
+        if (n == 2 || chance(0.15)) {
+            gen(n - 1);
+            token(funcs[pick(4)]);
+            return;
+        }
+        size_t left = 1 + pick(n - 2);
+        gen(left);
+        gen(n - 1 - left);
+        token(ops[pick(5)]);
+    }
+
+    string out;
+};
+
+// 给表达式中的每个变量取值；dropOne 时随机去掉一个（检查“变量未赋值”）
+static std::map<char, double> randomVars(const ExprTree& T, RandomExpr& R, bool dropOne) {
+    std::map<char, double> vars;
+    for (char c : T.collectVars()) vars[c] = R.value();
+    if (dropOne && !vars.empty()) {
+        auto it = vars.begin();
+        std::advance(it, (long)R.pick(vars.size()));
+        vars.erase(it);
+    }
+    return vars;
+}
+
+static string describe(const ExprTree& T, const std::map<char, double>& vars) {
+    string s = T.toPostfix() + " @";
+    for (const auto& kv : vars) s += " " + varNameFromCode(kv.first) + "=" + fmt(kv.second);
+    return s;
+}
+
+static vector<double> slotValues(const CompiledExpr& C, const std::map<char, double>& vars) {
+    vector<double> v(C.slotVars.size());
+    for (size_t i = 0; i < v.size(); ++i) v[i] = vars.at(C.slotVars[i]);
+    return v;
+}
+
+// ===================== 各项检查 =====================
+
+// 编译求值、CSE 求值与树上求值
+static void testCompile(const ExprTree& T, const std::map<char, double>& vars) {
+    double v0 = 0, v1 = 0, v2 = 0;
+    string e0, e1, e2;
+    bool ok0 = T.eval(vars, v0, &e0);
+
+    CompiledExpr C = CompileExpr(T);
+    bool ok1 = C.eval(vars, v1, &e1);
+    check(ok1 == ok0 && (ok0 ? sameValue(v0, v1) : e0 == e1), "compile",
+        describe(T, vars) + " eval=" + (ok0 ? fmt(v0) : "error") + " compiled=" + (ok1 ? fmt(v1) : "error"));
+
+    CseReport rep;
+    CompiledExpr S = CompileExprCse(T, &rep);
+    bool ok2 = S.eval(vars, v2, &e2);
+    check(ok2 == ok1 && (ok1 ? sameValue(v1, v2) : e1 == e2), "cse",
+        describe(T, vars) + " compile=" + (ok1 ? fmt(v1) : "error") + " cse=" + (ok2 ? fmt(v2) : "error"));
+}
+
+// 批量求值（串行与并行）逐行对照 eval；行数取奇数以覆盖 SIMD 尾部
+static void testBatch(const ExprTree& T, RandomExpr& R, WorkStealingPool& pool) {
+    const size_t n = 37;
+    CompiledExpr C = CompileExpr(T);
+    size_t slots = C.slotVars.size();
+    vector<vector<double>> cols(slots, vector<double>(n));
+    vector<const double*> colPtrs(slots);
+    for (size_t s = 0; s < slots; ++s) {
+        for (double& x : cols[s]) x = R.value();
+        colPtrs[s] = cols[s].data();
+    }
+
+    vector<double> out(n), outPar(n);
+    vector<unsigned char> st(n), stPar(n);
+    evalBatch(C, colPtrs.data(), n, out.data(), st.data());
+    evalBatchParallel(C, colPtrs.data(), n, outPar.data(), stPar.data(), pool, 4);
+
+    for (size_t i = 0; i < n; ++i) {
+        std::map<char, double> vars;
+        for (size_t s = 0; s < slots; ++s) vars[C.slotVars[s]] = cols[s][i];
+        double v = 0;
+        string err;
+        bool ok = T.eval(vars, v, &err);
+        unsigned char lane = ok ? (unsigned char)LANE_OK : laneFromError(err);
+        check(st[i] == lane && (ok ? sameValue(v, out[i]) : out[i] != out[i]), "batch",
+            describe(T, vars) + " eval=" + (ok ? fmt(v) : "error") + " batch=" + fmt(out[i]) +
+            " status=" + std::to_string(st[i]));
+        check(stPar[i] == st[i] && sameValue(outPar[i], out[i]), "batch",
+            describe(T, vars) + " serial=" + fmt(out[i]) + " parallel=" + fmt(outPar[i]));
+    }
+}
+
+// 区间包围：在每个变量的范围内采样（含端点），eval 成功且不是 NaN 的点必须落在区间内，
+// 标为每点都失败时不能有成功且非 NaN 的点，否则出现除零/ln 定义域错误的点必须有对应的标志
+static void testInterval(const ExprTree& T, RandomExpr& R) {
+    CompiledExpr C = CompileExprCse(T, nullptr);
+    size_t slots = C.slotVars.size();
+    vector<Interval> box(slots);
+    for (size_t s = 0; s < slots; ++s) {
+        double a = R.value(), b = R.chance(0.2) ? a : R.value();
+        box[s] = { (std::min)(a, b), (std::max)(a, b) };
+    }
+    Interval iv;
+    unsigned char flags = evalInterval(C, box.data(), iv);
+
+    for (int k = 0; k < 24; ++k) {
+        std::map<char, double> vars;
+        for (size_t s = 0; s < slots; ++s) {
+            double t = k == 0 ? 0 : k == 1 ? 1 : std::uniform_real_distribution<double>(0, 1)(R.rng);
+            double x = box[s].lo + t * (box[s].hi - box[s].lo);
+            vars[C.slotVars[s]] = (std::min)(box[s].hi, (std::max)(box[s].lo, x));
+        }
+        double v = 0;
+        string err;
+        bool ok = T.eval(vars, v, &err);
+        string where = describe(T, vars) + " interval=[" + fmt(iv.lo) + ", " + fmt(iv.hi) +
+            "] flags=" + std::to_string(flags);
+        if (ok && v == v) {
+            check(!(flags & IV_ALWAYS_FAIL) && iv.lo <= v && v <= iv.hi, "interval", where + " value=" + fmt(v));
+        }
+        else if (!ok && !(flags & IV_ALWAYS_FAIL)) {   // 每点都失败时求值提前结束，其余标志不完整
+            unsigned char lane = laneFromError(err);
+            if (lane == LANE_DIV_ZERO) check((flags & IV_DIV_ZERO) != 0, "interval", where + " div-zero not flagged");
+            if (lane == LANE_LN_DOMAIN) check((flags & IV_LN_DOMAIN) != 0, "interval", where + " ln-domain not flagged");
+        }
+    }
+}
+
+// 前向（树上/字节码上）与反向模式的值与偏导互相一致，并与符号求导树的求值一致
+static void testGradient(const ExprTree& T, const std::map<char, double>& vars) {
+    double v0 = 0;
+    if (!T.eval(vars, v0, nullptr)) return;
+
+    CompiledExpr C = CompileExprCse(T, nullptr);
+    vector<double> point = slotValues(C, vars);
+    GradientTape tape;
+    tape.build(C);
+    double tv = 0;
+    vector<double> grad(point.size());
+    string terr;
+    bool tok = tape.gradient(point.data(), tv, grad.data(), &terr);
+    check(tok && sameValue(tv, v0), "gradient", describe(T, vars) + " tape value " + (tok ? fmt(tv) : terr));
+    if (!tok) return;
+
+    for (size_t s = 0; s < C.slotVars.size(); ++s) {
+        char var = C.slotVars[s];
+        string name = " d/d" + varNameFromCode(var);
+        double fv = 0, fd = 0;
+        bool fok = evalDerivative(T, vars, var, fv, fd, nullptr);
+        Dual dual = { 0, 0 };
+        bool dok = evalDual(C, point.data(), (int)s, dual, nullptr);
+        if (!check(fok && dok && sameValue(fv, v0) && sameValue(dual.v, v0), "gradient",
+            describe(T, vars) + name + " forward value differs")) continue;
+
+        // 无定义的偏导（NaN）在前向与反向模式下的传播路径不同，只比较有限值；
+        // 函数值很大时偏导可能是大数相消的结果（如 (a^m)^(k/ln a) 对 a 的偏导为 0），各方法的舍入误差不可比
+        double dd = dual.d, td = grad[s];
+        if (std::isfinite(fd) && std::isfinite(dd) && std::isfinite(td) && std::fabs(fd) < 1e8 && std::fabs(v0) < 1e6) {
+            check(closeValue(fd, dd, 1e-12) && closeValue(fd, td, 1e-7), "gradient",
+                describe(T, vars) + name + " tree=" + fmt(fd) + " dual=" + fmt(dd) + " tape=" + fmt(td));
+
+            ExprTree D = DerivativeTree(T, var, nullptr);
+            double sd = 0;
+            if (D.root && D.eval(vars, sd, nullptr) && std::isfinite(sd))
+                check(closeValue(fd, sd, 1e-7), "gradient",
+                    describe(T, vars) + name + " symbolic=" + fmt(sd) + " forward=" + fmt(fd));
+        }
+    }
+}
+
+// DAG 上的求值、求导、化简与树上的对应算法一致：dagEval 与 eval 逐位一致、报错相同（求值和化简用保留 -0 的仓库）；
+// derivNode、simplify 的结果导入仓库后与 dagDerivative、dagSimplify 的结果是同一个节点（折叠和化简规则一致）
+static void testDag(const ExprTree& T, const std::map<char, double>& vars) {
+    DagStore exact(false);
+    double v0 = 0, v1 = 0;
+    string e0, e1;
+    bool ok0 = T.eval(vars, v0, &e0);
+    bool ok1 = dagEval(exact.intern(T.root), vars, v1, &e1);
+    check(ok1 == ok0 && (ok0 ? sameValue(v0, v1) : e0 == e1), "dag",
+        describe(T, vars) + " eval=" + (ok0 ? fmt(v0) : "error") + " dagEval=" + (ok1 ? fmt(v1) : "error"));
+
+    ExprTree simple = T.clone();
+    simple.simplify();
+    Node* ds = dagSimplify(exact, exact.intern(T.root));
+    check(exact.intern(simple.root) == ds, "dag", T.toPostfix() + " simplify=" + simple.toInfix() +
+        " dagSimplify=" + dagToTree(ds).toInfix());
+
+    DagStore S;
+    Node* root = S.intern(T.root);
+    for (char var : T.collectVars()) {
+        ExprTree D = DerivativeTree(T, var, nullptr);
+        Node* d = dagDerivative(S, root, var, nullptr);
+        check(d && S.intern(D.root) == d, "dag", T.toPostfix() + " d/d" + varNameFromCode(var) +
+            " tree=" + D.toInfix() + " dag=" + (d ? dagToTree(d).toInfix() : "error"));
+    }
+}
+
+// 高阶偏导：Hessian、混合偏导、n 阶导数与逐次调用 DerivativeTree 的结果导入同一仓库后是同一个节点，
+// Hessian 只求上三角，下三角与之是同一个节点；GradientTree 为反向模式累加，结构不同，只与 DerivativeTree 比较数值
+static void testHigherOrder(const ExprTree& T, const std::map<char, double>& vars) {
+    size_t nodes = treeNodeCount(T.root);
+    if (nodes > 30) return;   // 逐次求导得到的树膨胀很快
+    std::set<char> vs = T.collectVars();
+    vector<char> v(vs.begin(), vs.end());
+    string where = describe(T, vars);
+    auto evalNode = [&](Node* p, double& out) { return dagEval(p, vars, out, nullptr) && std::isfinite(out) && std::fabs(out) < 1e6; };
+
+    DagStore S;
+    HessianTree H;
+    GradientTree G;
+    if (!check(H.build(T, nullptr) && G.build(T, nullptr), "higher", where + " build failed")) return;
+    for (size_t i = 0; i < v.size(); ++i) {
+        ExprTree Di = DerivativeTree(T, v[i], nullptr);
+        string di = where + " d/d" + varNameFromCode(v[i]);
+        double a = 0, b = 0;
+        if (evalNode(Di.root, a) && evalNode(G.partial(0, i), b))
+            check(closeValue(a, b, 1e-7), "higher", di + " gradient=" + fmt(b) + " derivative=" + fmt(a));
+
+        for (size_t k = 0; k < v.size(); ++k) {
+            ExprTree Dik = DerivativeTree(Di, v[k], nullptr);
+            string dik = di + " d/d" + varNameFromCode(v[k]);
+            Node* ref = S.intern(Dik.root);
+            vector<char> order = { v[i], v[k] };
+            check(S.intern(MixedPartialTree(T, order, nullptr).root) == ref, "higher", dik + " mixed partial");
+            if (k >= i) check(S.intern(H.partial(i, k)) == ref, "higher", dik + " hessian");
+            else check(H.partial(i, k) == H.partial(k, i), "higher", dik + " hessian is not symmetric");
+        }
+    }
+    if (!v.empty() && nodes <= 12) {
+        ExprTree D = T.clone();
+        for (int n = 0; n < 3; ++n) D = DerivativeTree(D, v[0], nullptr);
+        check(S.intern(NthDerivativeTree(T, v[0], 3, nullptr).root) == S.intern(D.root), "higher",
+            where + " third derivative");
+    }
+}
+
+// 后缀串往返：重新解析 toPostfix 的输出得到相同的串、中缀和值
+static void testRoundTrip(const ExprTree& T, const std::map<char, double>& vars) {
+    string post = T.toPostfix();
+    ExprTree U;
+    string err;
+    if (!check(U.buildFromPostfixChars(post, &err), "postfix", post + " does not parse back")) return;
+    check(U.toPostfix() == post && U.toInfix() == T.toInfix(), "postfix",
+        post + " -> " + U.toPostfix() + " / " + T.toInfix() + " -> " + U.toInfix());
+    double a = 0, b = 0;
+    string ea, eb;
+    bool oka = T.eval(vars, a, &ea), okb = U.eval(vars, b, &eb);
+    check(oka == okb && (oka ? sameValue(a, b) : ea == eb), "postfix", describe(T, vars) + " value changed");
+}
+
+// ---------- 流式读入 ----------
+
+static string streamInput(size_t& longLine) {
+    string s;
+    s += "ab+\n";                 // 1
+    s += "\n";                    // 2 空行
+    s += "  \t\n";                // 3 只有空白
+    s += "a0/\r\n";               // 4 CRLF；能建树（求值才除零）
+    s += "ab\n";                  // 5 缺运算符
+    s += "[x1][longer_name]*\n";  // 6
+    s += "+\n";                   // 7 缺操作数
+    s += "[1.5\n";                // 8 未闭合的方括号
+    string chain = "a";
+    for (int i = 0; i < 3000; ++i) chain += "1+";
+    longLine = chain.size();
+    s += chain + "\n";            // 9 比读缓冲长得多的一行
+    // 10 起：每行两个新的多字符变量名，总数超过一张名字表的容量
+    for (int i = 0; i < 300; ++i)
+        s += "[p" + std::to_string(i) + "][q" + std::to_string(i) + "]-\n";
+    s += "c";                     // 最后一行没有换行符
+    return s;
+}
+
+static void checkStream(const char* how, bool readOk, const StreamStats& st, const vector<size_t>& errLines,
+    size_t treeCount, size_t longLine, size_t bytes) {
+    string w = string(how) + ": ";
+    check(readOk, "stream", w + "read failed");
+    check(st.lines == 310 && st.records == 308 && st.parsed == 305 && st.failed == 3, "stream",
+        w + "lines=" + std::to_string(st.lines) + " records=" + std::to_string(st.records) +
+        " parsed=" + std::to_string(st.parsed) + " failed=" + std::to_string(st.failed));
+    check(st.maxLine == longLine && st.bytes == bytes + 1, "stream",
+        w + "maxLine=" + std::to_string(st.maxLine) + " bytes=" + std::to_string(st.bytes));
+    check(errLines == vector<size_t>({ 5, 7, 8 }), "stream", w + "error lines");
+    check(treeCount == st.parsed, "stream", w + "onTree calls");
+}
+
+static void testStream() {
+    size_t longLine = 0;
+    string text = streamInput(longLine);
+    size_t namesBefore = snapshotVarNames().size();
+
+    std::map<char, double> vars{ { 'a', 2 }, { 'b', 3 }, { 'c', 4 } };
+    auto run = [&](const char* how, const std::function<bool(const StreamTreeFn&, const StreamErrorFn&, StreamStats*)>& read) {
+        StreamStats st;
+        vector<size_t> errLines;
+        size_t trees = 0;
+        bool ok = read(
+            [&](const StreamRecord& rec, ExprTree& T) {
+                ++trees;
+                double v = 0;
+                if (rec.line == 1) check(T.eval(vars, v, nullptr) && v == 5, "stream", string(how) + ": line 1 value");
+                if (rec.line == 9) check(T.eval(vars, v, nullptr) && v == 3002, "stream", string(how) + ": long line value");
+                if (rec.line >= 10 && rec.line < 310) check(T.collectVars().size() == 2, "stream",
+                    string(how) + ": line " + std::to_string(rec.line) + " variables");
+                return true;
+            },
+            [&](const StreamRecord& rec, const string&) { errLines.push_back(rec.line); return true; },
+            &st);
+        checkStream(how, ok, st, errLines, trees, longLine, text.size());
+    };
+
+    FILE* f = std::tmpfile();
+    if (!check(f != nullptr, "stream", "tmpfile")) return;
+    std::fwrite(text.data(), 1, text.size(), f);
+    auto fromFile = [&](size_t chunk) {
+        return [&, chunk](const StreamTreeFn& onTree, const StreamErrorFn& onError, StreamStats* st) {
+            std::rewind(f);
+            return streamPostfix(f, onTree, onError, st, nullptr, chunk);
+        };
+    };
+    run("chunked", fromFile(STREAM_CHUNK));
+    run("small chunk", fromFile(16));
+
+    // 回调返回 false 时停止读入
+    std::rewind(f);
+    StreamStats st;
+    streamPostfix(f, [](const StreamRecord& rec, ExprTree&) { return rec.line < 6; }, nullptr, &st, nullptr);
+    check(st.lines == 6 && st.parsed == 3, "stream", "stop: lines=" + std::to_string(st.lines));
+    std::fclose(f);
+
+    // 内存映射读取（写到当前目录的临时文件）
+    const char* path = "test_core_stream.txt";
+    FILE* out = std::fopen(path, "wb");
+    if (check(out != nullptr, "stream", "cannot create " + string(path))) {
+        std::fwrite(text.data(), 1, text.size(), out);
+        std::fclose(out);
+        run("mmap", [&](const StreamTreeFn& onTree, const StreamErrorFn& onError, StreamStats* s) {
+            return streamPostfixFile(path, true, onTree, onError, s, nullptr);
+        });
+        std::remove(path);
+    }
+
+    string err;
+    check(!streamPostfixFile("test_core_missing.txt", false, nullptr, nullptr, nullptr, &err) && !err.empty(),
+        "stream", "missing file is not reported");
+    check(snapshotVarNames().size() == namesBefore, "stream", "caller's name table changed");
+}
+
+// ---------- 线程池 ----------
+
+static void testPool(WorkStealingPool& pool) {
+    // 任务内部再次调用 parallelFor：在当前线程串行执行，结果完整
+    vector<int> hits(64 * 64, 0);
+    pool.parallelFor(64, 1, [&](size_t b, size_t e) {
+        for (size_t i = b; i < e; ++i)
+            pool.parallelFor(64, 8, [&](size_t b2, size_t e2) {
+                for (size_t j = b2; j < e2; ++j) ++hits[i * 64 + j];
+            });
+    });
+    bool all = true;
+    for (int h : hits) all = all && h == 1;
+    check(all, "pool", "nested parallelFor");
+
+    // 块抛出的异常在调用线程上重新抛出，之后线程池仍可使用
+    bool caught = false;
+    try {
+        pool.parallelFor(100, 1, [](size_t b, size_t) {
+            if (b == 37) throw std::runtime_error("chunk 37");
+        });
+    }
+    catch (const std::runtime_error& e) {
+        caught = string(e.what()) == "chunk 37";
+    }
+    check(caught, "pool", "exception not propagated");
+    size_t sum = 0;
+    std::mutex m;
+    pool.parallelFor(1000, 10, [&](size_t b, size_t e) {
+        std::lock_guard<std::mutex> lk(m);
+        for (size_t i = b; i < e; ++i) sum += i;
+    });
+    check(sum == 999 * 1000 / 2, "pool", "pool unusable after exception");
+}
+
+int main(int argc, char** argv) {
+    unsigned seed = argc > 1 ? (unsigned)std::strtoul(argv[1], nullptr, 10) : 1;
+    size_t count = argc > 2 ? (size_t)std::strtoull(argv[2], nullptr, 10) : 400;
+
+    loadErrorMessages();
+    RandomExpr R(seed);
+    WorkStealingPool pool(4);
+    ExprTree T;
+
+    for (size_t k = 0; k < count; ++k) {
+        string src = R.postfix(1 + R.pick(k % 4 == 3 ? 200 : 24));
+        string err;
+        if (!check(T.buildFromPostfixChars(src, &err), "postfix", src + " does not parse")) continue;
+
+        std::map<char, double> vars = randomVars(T, R, R.chance(0.1));
+        testCompile(T, vars);
+        testRoundTrip(T, vars);
+        testBatch(T, R, pool);
+        testInterval(T, R);
+        testGradient(T, randomVars(T, R, false));
+        testDag(T, vars);
+        testHigherOrder(T, randomVars(T, R, false));
+    }
+    testStream();
+    testPool(pool);
+
+    std::printf("seed %u, %zu expressions: %zu checks, %zu failures\n", seed, count, g_checks, g_failures);
+    return g_failures ? 1 : 0;
+}